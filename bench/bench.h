@@ -0,0 +1,65 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "headless.h"
+
+/*
+ * Benchmark scenarios. Every scenario fills one bench_result, and
+ * main.c prints all of them as JSON, so results may be compared between
+ * releases. Scenarios are deterministic : fixed seeds, fixed world
+ * modes, fixed amount of work.
+ */
+
+// latency samples, in ns
+struct bench_lat {
+	uint64_t* v;
+	int len, cap;
+};
+
+void latPush(struct bench_lat* l, uint64_t ns);
+uint64_t latPercentile(struct bench_lat* l, float p); // 0..1
+void latFree(struct bench_lat* l);
+
+struct bench_result {
+	double   seconds; // of the measured part only
+	uint64_t ticks;   // simulation ticks, 0 if scenario is not tick based
+	uint64_t chunks;  // chunks processed (updated, generated, saved...)
+	struct bench_lat lat; // per tick or per operation
+};
+
+// opens world with fixed seed, and initializes headless mode
+bool benchOpenWorld(const char* path, int mode, struct headless_view view);
+void benchCloseWorld(); // saves it!
+
+// ticks, sums update queue length as processed chunks
+void benchTicks(struct bench_result* r, int ticks);
+
+// scenarios
+void benchSandAvalanche(struct bench_result* r);
+void benchWaterFlood(struct bench_result* r);
+void benchWaterSolver(struct bench_result* r);
+void benchGenNormal(struct bench_result* r);
+void benchGenFlat(struct bench_result* r);
+void benchGenSponge(struct bench_result* r);
+void benchDiskMemory(struct bench_result* r);
+void benchDiskFile(struct bench_result* r);
+void benchHashmap(struct bench_result* r);
+void benchAllocator(struct bench_result* r);
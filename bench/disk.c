@@ -0,0 +1,77 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "bench.h"
+#include "implix.h"
+#include "profiler.h"
+#include <stdio.h>
+
+#define DISK_WIDTH 48 // DISK_WIDTH^2 chunks are saved, then loaded
+#define DISK_FILE  "./bench-world.db"
+
+static void saveload(struct bench_result* r, const char* path) {
+	initWorld();
+	openWorld(path);
+	setWorldSeed(1337);
+	World.mode = 0;
+
+	struct chunk* c = allocChunk(0, 0);
+	for (int y = 0; y < DISK_WIDTH; y++) {
+		for (int x = 0; x < DISK_WIDTH; x++) {
+			c->pos.axis[0] = x;
+			c->pos.axis[1] = y;
+			generateChunk(c);
+
+			uint64_t start = prof_clock();
+			saveChunk(c);
+			uint64_t time = prof_clock() - start;
+			latPush(&r->lat, time);
+			r->seconds += time / 1e9;
+			r->chunks++;
+		}
+	}
+
+	int missing = 0;
+	for (int y = 0; y < DISK_WIDTH; y++) {
+		for (int x = 0; x < DISK_WIDTH; x++) {
+			c->pos.axis[0] = x;
+			c->pos.axis[1] = y;
+
+			uint64_t start = prof_clock();
+			missing += loadChunk(c) <= 0;
+			uint64_t time = prof_clock() - start;
+			latPush(&r->lat, time);
+			r->seconds += time / 1e9;
+			r->chunks++;
+		}
+	}
+	freeChunk(c);
+	if (missing) fprintf(stderr, "bench : %i chunks were not loaded back!\n", missing);
+
+	freeWorld();
+}
+
+void benchDiskMemory(struct bench_result* r) {
+	saveload(r, ":memory:");
+}
+
+void benchDiskFile(struct bench_result* r) {
+	remove(DISK_FILE);
+	saveload(r, DISK_FILE);
+	remove(DISK_FILE);
+}
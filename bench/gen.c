@@ -0,0 +1,55 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "bench.h"
+#include "implix.h"
+#include "profiler.h"
+
+#define GEN_WIDTH 48 // GEN_WIDTH^2 chunks are generated
+
+static void genMode(struct bench_result* r, int mode) {
+	initWorld();
+	setWorldSeed(1337);
+	World.mode = mode;
+
+	for (int y = 0; y < GEN_WIDTH; y++) {
+		for (int x = 0; x < GEN_WIDTH; x++) {
+			struct chunk* c = allocChunk(x - GEN_WIDTH/2, y - GEN_WIDTH/2);
+			uint64_t start = prof_clock();
+			generateChunk(c);
+			uint64_t time = prof_clock() - start;
+			freeChunk(c);
+
+			latPush(&r->lat, time);
+			r->seconds += time / 1e9;
+			r->chunks++;
+		}
+	}
+}
+
+void benchGenNormal(struct bench_result* r) {
+	genMode(r, 0);
+}
+
+void benchGenFlat(struct bench_result* r) {
+	genMode(r, 1);
+}
+
+void benchGenSponge(struct bench_result* r) {
+	genMode(r, 2);
+}
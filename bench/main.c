@@ -0,0 +1,111 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "bench.h"
+#include "implix.h"
+#include "profiler.h"
+#include "version.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * pixelbox-bench [filter]
+ * Runs all scenarios (or ones, which names contain filter), and prints
+ * results as JSON to stdout. Progress goes to stderr.
+ */
+
+static const struct {
+	const char* name;
+	void (*run)(struct bench_result* r);
+} scenarios[] = {
+	{"sand_avalanche", benchSandAvalanche},
+	{"water_flood",    benchWaterFlood},
+	{"water_solver",   benchWaterSolver},
+	{"gen_normal",     benchGenNormal},
+	{"gen_flat",       benchGenFlat},
+	{"gen_sponge",     benchGenSponge},
+	{"saveload_memory", benchDiskMemory},
+	{"saveload_file",  benchDiskFile},
+	{"hashmap",        benchHashmap},
+	{"allocator",      benchAllocator},
+	{NULL, NULL}
+};
+
+void latPush(struct bench_lat* l, uint64_t ns) {
+	if (l->len >= l->cap) {
+		int cap = l->cap ? l->cap * 2 : 1024;
+		uint64_t* v = realloc(l->v, cap * sizeof(uint64_t));
+		if (!v) return;
+		l->v = v;
+		l->cap = cap;
+	}
+	l->v[l->len++] = ns;
+}
+
+static int cmp64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+uint64_t latPercentile(struct bench_lat* l, float p) {
+	if (!l->len) return 0;
+	qsort(l->v, l->len, sizeof(uint64_t), cmp64);
+	int i = l->len * p;
+	if (i >= l->len) i = l->len - 1;
+	return l->v[i];
+}
+
+void latFree(struct bench_lat* l) {
+	free(l->v);
+	memset(l, 0, sizeof(struct bench_lat));
+}
+
+static void report(const char* name, struct bench_result* r, bool first) {
+	double s = r->seconds > 0 ? r->seconds : 1e-9;
+	printf("%s\n    {\"name\": \"%s\", \"seconds\": %.6f, ", first ? "" : ",", name, r->seconds);
+	if (r->ticks) printf("\"ticks\": %llu, \"ticks_per_s\": %.2f, ",
+		(unsigned long long)r->ticks, r->ticks / s);
+	else printf("\"ticks\": 0, \"ticks_per_s\": null, ");
+	printf("\"chunks\": %llu, \"chunks_per_s\": %.2f, \"p50_ms\": %.6f, \"p99_ms\": %.6f}",
+		(unsigned long long)r->chunks, r->chunks / s,
+		latPercentile(&r->lat, 0.50) / 1e6, latPercentile(&r->lat, 0.99) / 1e6);
+}
+
+int main(int argc, char** argv) {
+	const char* filter = argc > 1 ? argv[1] : NULL;
+	prof_register_thread();
+
+	printf("{\n  \"version\": \"%s\",\n  \"results\": [", PBOX_VERSION);
+	bool first = true;
+	for (int i = 0; scenarios[i].name; i++) {
+		if (filter && !strstr(scenarios[i].name, filter)) continue;
+		fprintf(stderr, "bench : %s...\n", scenarios[i].name);
+
+		struct bench_result r = {0};
+		scenarios[i].run(&r);
+		report(scenarios[i].name, &r, first);
+		latFree(&r.lat);
+		first = false;
+		fflush(stdout);
+	}
+	printf("\n  ]\n}\n");
+
+	prof_unregister_thread();
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "bench.h"
+#include "implix.h"
+#include "profiler.h"
+#include <string.h>
+
+/*
+ * Single operations are too short to be timed one by one, so latencies
+ * here are per operation, averaged over batches of BATCH operations.
+ */
+#define MICRO_WIDTH 128 // MICRO_WIDTH^2 chunks
+#define MICRO_COUNT (MICRO_WIDTH*MICRO_WIDTH)
+#define BATCH 256
+
+static struct chunk* chunks[MICRO_COUNT];
+
+static void batch(struct bench_result* r, uint64_t start) {
+	uint64_t time = prof_clock() - start;
+	latPush(&r->lat, time / BATCH);
+	r->seconds += time / 1e9;
+	r->chunks  += BATCH;
+}
+
+void benchHashmap(struct bench_result* r) {
+	struct chunkmap m;
+	memset(&m, 0, sizeof(m));
+	m.g = true; // uses next, as World.map
+
+	for (int i = 0; i < MICRO_COUNT; i++)
+		chunks[i] = allocChunk(i % MICRO_WIDTH, i / MICRO_WIDTH);
+
+	for (int i = 0; i < MICRO_COUNT; i += BATCH) {
+		uint64_t start = prof_clock();
+		for (int j = i; j < i + BATCH; j++) insertChunk(&m, chunks[j]);
+		batch(r, start);
+	}
+
+	int found = 0;
+	for (int i = 0; i < MICRO_COUNT; i += BATCH) {
+		uint64_t start = prof_clock();
+		for (int j = i; j < i + BATCH; j++)
+			found += !!findChunk(&m, j % MICRO_WIDTH, j / MICRO_WIDTH);
+		batch(r, start);
+	}
+
+	for (int i = 0; i < MICRO_COUNT; i += BATCH) {
+		uint64_t start = prof_clock();
+		for (int j = i; j < i + BATCH; j++) removeChunk(&m, chunks[j]);
+		batch(r, start);
+	}
+
+	for (int i = 0; i < MICRO_COUNT; i++) freeChunk(chunks[i]);
+	if (found != MICRO_COUNT) r->chunks = 0; // broken!
+}
+
+void benchAllocator(struct bench_result* r) {
+	for (int round = 0; round < 4; round++) {
+		for (int i = 0; i < MICRO_COUNT; i += BATCH) {
+			uint64_t start = prof_clock();
+			for (int j = i; j < i + BATCH; j++) chunks[j] = allocChunk(j, round);
+			batch(r, start);
+		}
+		// free in the other order, to make free list less friendly
+		for (int i = MICRO_COUNT - BATCH; i >= 0; i -= BATCH) {
+			uint64_t start = prof_clock();
+			for (int j = i + BATCH - 1; j >= i; j--) freeChunk(chunks[j]);
+			batch(r, start);
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "bench.h"
+#include "implix.h"
+#include "profiler.h"
+#include <stdio.h>
+
+#define BENCH_SEED 1337
+#define SIM_TICKS  512
+
+bool benchOpenWorld(const char* path, int mode, struct headless_view view) {
+	initWorld();
+	openWorld(path);
+	setWorldSeed(BENCH_SEED);
+	World.mode = mode;
+	if (!initHeadless(view)) return false;
+	if (!headlessWaitView(100000)) {
+		fprintf(stderr, "bench : view was not loaded!\n");
+		return false;
+	}
+	return true;
+}
+
+void benchCloseWorld() {
+	freeHeadless();
+	freeWorld();
+}
+
+void benchTicks(struct bench_result* r, int ticks) {
+	for (int i = 0; i < ticks; i++) {
+		int queued = 0;
+		for (int j = 0; j < MAPLEN; j++)
+			for (struct chunk* c = World.update.data[j]; c; c = c->next2) queued++;
+
+		uint64_t start = prof_clock();
+		headlessTick();
+		uint64_t time = prof_clock() - start;
+
+		latPush(&r->lat, time);
+		r->seconds += time / 1e9;
+		r->chunks  += queued;
+		r->ticks++;
+		prof_step();
+	}
+}
+
+// floor of the flat world is at y = 64, see headlessFill()
+static const struct headless_view flat_view = {-10, -10, 10, 4};
+
+void benchSandAvalanche(struct bench_result* r) {
+	if (!benchOpenWorld(":memory:", 1, flat_view)) return;
+	headlessFill(-64, -120, 64, 60, 1 << 2); // sand pile
+	benchTicks(r, SIM_TICKS);
+	benchCloseWorld();
+}
+
+void benchWaterFlood(struct bench_result* r) {
+	if (!benchOpenWorld(":memory:", 1, flat_view)) return;
+	headlessFill(-120, -100, 120, 40, 2 << 2); // big water block
+	benchTicks(r, SIM_TICKS);
+	benchCloseWorld();
+}
+
+void benchWaterSolver(struct bench_result* r) {
+	if (!benchOpenWorld(":memory:", 1, flat_view)) return;
+	World.water_solver = true;
+	headlessFill(-120, -100, 120, 40, 2 << 2); // same block, leveled in bulk
+	benchTicks(r, SIM_TICKS);
+	World.water_solver = false;
+	benchCloseWorld();
+}
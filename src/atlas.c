@@ -0,0 +1,133 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "atlas.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static void cleanDirty(struct atlas* a) {
+	for (int i = 0; i < a->height; i++) a->dirty_min[i] = -1;
+	a->dirty_first = a->height;
+	a->dirty_last  = -1;
+}
+
+bool initAtlas(struct atlas* a, int tile, int width, int height) {
+	size_t size = (size_t)tile*tile*width*height;
+	memset(a, 0, sizeof(struct atlas));
+	a->pixels  = calloc(size, 1);
+	a->staging = calloc(size, 1);
+	a->dirty_min = calloc(height, sizeof(int16_t));
+	a->dirty_max = calloc(height, sizeof(int16_t));
+
+	if (!a->pixels || !a->staging || !a->dirty_min || !a->dirty_max) {
+		perror("NOMEM!");
+		freeAtlas(a);
+		return false;
+	}
+
+	a->tile   = tile;
+	a->width  = width;
+	a->height = height;
+	cleanDirty(a);
+	return true;
+}
+
+void freeAtlas(struct atlas* a) {
+	free(a->pixels);
+	free(a->staging);
+	free(a->dirty_min);
+	free(a->dirty_max);
+	memset(a, 0, sizeof(struct atlas));
+}
+
+void atlasMark(struct atlas* a, int index) {
+	int x = index % a->width;
+	int y = index / a->width;
+	assert(y < a->height && "atlas index out of range");
+
+	if (a->dirty_min[y] < 0) {
+		a->dirty_min[y] = x;
+		a->dirty_max[y] = x;
+	} else {
+		a->dirty_min[y] = MIN(a->dirty_min[y], x);
+		a->dirty_max[y] = MAX(a->dirty_max[y], x);
+	}
+	a->dirty_first = MIN(a->dirty_first, y);
+	a->dirty_last  = MAX(a->dirty_last, y);
+}
+
+void atlasPut(struct atlas* a, int index, const uint8_t* data) {
+	int x = index % a->width;
+	int y = index / a->width;
+	int pitch = a->width * a->tile;
+	uint8_t* dst = a->pixels + (y * a->tile) * pitch + x * a->tile;
+
+	for (int i = 0; i < a->tile; i++) {
+		memcpy(dst + i * pitch, data + i * a->tile, a->tile);
+	}
+	atlasMark(a, index);
+}
+
+bool atlasNextSpan(struct atlas* a, struct atlas_span* span) {
+	int y = a->dirty_first;
+	while (y <= a->dirty_last && a->dirty_min[y] < 0) y++;
+	if (y > a->dirty_last) { // nothing left
+		cleanDirty(a);
+		return false;
+	}
+
+	int x0 = a->dirty_min[y], x1 = a->dirty_max[y];
+	int y0 = y;
+	a->dirty_min[y] = -1;
+
+	// merge next rows, while they are dirty and overlap (or touch) us.
+	// Not overlapping rows are left for the next span, so we will not
+	// upload a whole texture width because of two far away tiles.
+	for (y = y0 + 1; y <= a->dirty_last; y++) {
+		int n0 = a->dirty_min[y], n1 = a->dirty_max[y];
+		if (n0 < 0 || n0 > x1 + 1 || n1 < x0 - 1) break;
+		x0 = MIN(x0, n0);
+		x1 = MAX(x1, n1);
+		a->dirty_min[y] = -1;
+	}
+	a->dirty_first = y;
+
+	span->x = x0 * a->tile;
+	span->y = y0 * a->tile;
+	span->width  = (x1 - x0 + 1) * a->tile;
+	span->height = (y - y0) * a->tile;
+
+	// pack span into the staging buffer (UpdateTextureRec() wants
+	// rectangle data to be contiguous)
+	int pitch = a->width * a->tile;
+	const uint8_t* src = a->pixels + span->y * pitch + span->x;
+	if (span->width == pitch) {
+		span->data = src; // already contiguous :p
+	} else {
+		for (int i = 0; i < span->height; i++) {
+			memcpy(a->staging + i * span->width, src + i * pitch, span->width);
+		}
+		span->data = a->staging;
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * CPU side of the render atlas.
+ *
+ * Tiles are not uploaded to the GPU one by one anymore. Instead they are
+ * staged into a mirror of the atlas texture, and dirty tiles are tracked
+ * per tile row. At the end of the frame dirty rows are merged into spans,
+ * and every span is uploaded with ONE UpdateTextureRec() call.
+ *
+ * There is no GL stuff in here, so this can be used (and poked) without
+ * a window or a GL context at all.
+ */
+
+struct atlas_span {
+	int x, y;          // in pixels
+	int width, height; // in pixels
+	const uint8_t* data; // width*height bytes, valid until next call
+};
+
+struct atlas {
+	uint8_t* pixels;  // mirror of the texture
+	uint8_t* staging; // packed span data
+	int16_t* dirty_min; // first dirty tile in the tile row or -1
+	int16_t* dirty_max; // last dirty tile in the tile row
+	int tile;   // tile size in pixels
+	int width;  // in tiles
+	int height; // in tiles
+	int dirty_first, dirty_last; // range of dirty tile rows
+};
+
+bool initAtlas(struct atlas* a, int tile, int width, int height);
+void freeAtlas(struct atlas* a);
+
+// copies tile*tile bytes into the tile at index, and marks it dirty
+void atlasPut(struct atlas* a, int index, const uint8_t* data);
+
+// marks tile at index as dirty without touching it's content
+void atlasMark(struct atlas* a, int index);
+
+/*
+ * Pops next merged dirty span. Returns false when there is nothing
+ * left to upload. Consecutive dirty tile rows are merged into one span,
+ * covering all dirty tiles of these rows.
+ */
+bool atlasNextSpan(struct atlas* a, struct atlas_span* span);
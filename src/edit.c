@@ -0,0 +1,530 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "implix.h"
+#include "edit.h"
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SHAPE_SIZE_MAX (1 << 12) // pixels, per axis. Don't load half a world
+#define FILL_STACK_MAX (1 << 16) // seeds, the rest of the fill is dropped
+#define EDIT_SALT 0xED17ull // separates brush randomness from the simulation
+
+static inline int64_t chunkOf(int64_t v) { // floor, unlike /
+	return v >= 0 ? v / CHUNK_WIDTH : -((-v + CHUNK_WIDTH - 1) / CHUNK_WIDTH);
+}
+
+static inline int64_t min64(int64_t a, int64_t b) {return a < b ? a : b;}
+static inline int64_t max64(int64_t a, int64_t b) {return a > b ? a : b;}
+
+// row ry of the chunk, cells a..b inclusive
+static void paintSpan(struct chunk* c, int ry, int a, int b, struct world_paint p) {
+	uint8_t* row = getChunkData(c, MODE_READ) + ry * CHUNK_WIDTH;
+	if (!p.random) {
+		memset(row + a, p.v, b - a + 1);
+		return;
+	}
+
+	// same (tick, pixel) gives the same value, see pixel.h
+	uint8_t rnd[CHUNK_WIDTH];
+	rngFillBytes(rngKey(World.seed ^ EDIT_SALT, World.tick, c->pos.pack),
+		ry * CHUNK_WIDTH / 8, rnd, CHUNK_WIDTH);
+	const uint8_t keep = p.v & ~p.random;
+	for (int i = a; i <= b; i++) row[i] = keep | (rnd[i] & p.random);
+}
+
+static void changedChunk(struct chunk* c) {
+	c->is_changed = 1;
+	touchChunk(c);
+	markWorldUpdate((int64_t)c->pos.axis[0] * CHUNK_WIDTH,
+		(int64_t)c->pos.axis[1] * CHUNK_WIDTH);
+}
+
+/*
+ * Convex shapes : span of every row is one interval, so it's enough to
+ * know it's ends. Pixels are painted if their centers (integer coords)
+ * are inside.
+ */
+
+// [lo, hi] &= {x : a*x + b in [c, d]}
+static void clipLinear(double a, double b, double c, double d, double* lo, double* hi) {
+	if (a == 0) {
+		if (b < c || b > d) *hi = -INFINITY;
+		return;
+	}
+	double x0 = (c - b) / a, x1 = (d - b) / a;
+	if (x0 > x1) {double t = x0; x0 = x1; x1 = t;}
+	if (x0 > *lo) *lo = x0;
+	if (x1 < *hi) *hi = x1;
+}
+
+static void circleSpan(double cx, double cy, double r, double y, double* lo, double* hi) {
+	double dy = y - cy;
+	if (dy * dy > r * r) return;
+	double w = sqrt(r * r - dy * dy);
+	if (cx - w < *lo) *lo = cx - w;
+	if (cx + w > *hi) *hi = cx + w;
+}
+
+static bool rowSpan(const struct world_shape* s, int64_t y, int64_t* xa, int64_t* xb) {
+	double lo = INFINITY, hi = -INFINITY;
+	switch (s->kind) {
+		case SHAPE_RECT:
+			if (y < min64(s->y0, s->y1) || y > max64(s->y0, s->y1)) return false;
+			*xa = min64(s->x0, s->x1);
+			*xb = max64(s->x0, s->x1);
+			return true;
+		case SHAPE_CIRCLE:
+			circleSpan(s->x0, s->y0, s->radius + 0.5, y, &lo, &hi);
+		break;
+		case SHAPE_LINE: { // capsule : two caps and a band between
+			const double r = s->radius + 0.5;
+			circleSpan(s->x0, s->y0, r, y, &lo, &hi);
+			circleSpan(s->x1, s->y1, r, y, &lo, &hi);
+
+			double dx = s->x1 - s->x0, dy = s->y1 - s->y0;
+			double len = sqrt(dx * dx + dy * dy);
+			if (len == 0) break;
+			double blo = -INFINITY, bhi = INFINITY;
+			double ry = y - s->y0; // x is relative to x0 below
+			clipLinear(-dy, dx * ry, -r * len, r * len, &blo, &bhi); // distance
+			clipLinear(dx, dy * ry, 0, len * len, &blo, &bhi); // projection
+			if (blo <= bhi) {
+				if (blo + s->x0 < lo) lo = blo + s->x0;
+				if (bhi + s->x0 > hi) hi = bhi + s->x0;
+			}
+		} break;
+		default: return false;
+	}
+	if (lo > hi) return false;
+	*xa = ceil(lo);
+	*xb = floor(hi);
+	return *xa <= *xb;
+}
+
+static void shapeBounds(const struct world_shape* s, int64_t b[4]) {
+	int64_t r = s->kind == SHAPE_RECT ? 0 : s->radius + 1;
+	int64_t x1 = s->kind == SHAPE_CIRCLE ? s->x0 : s->x1;
+	int64_t y1 = s->kind == SHAPE_CIRCLE ? s->y0 : s->y1;
+	b[0] = min64(s->x0, x1) - r;
+	b[1] = min64(s->y0, y1) - r;
+	b[2] = max64(s->x0, x1) + r;
+	b[3] = max64(s->y0, y1) + r;
+}
+
+static int64_t paintConvex(const struct world_shape* s) {
+	int64_t b[4], total = 0;
+	shapeBounds(s, b);
+	if (b[2] - b[0] >= SHAPE_SIZE_MAX || b[3] - b[1] >= SHAPE_SIZE_MAX) return 0;
+
+	int64_t xa[CHUNK_WIDTH], xb[CHUNK_WIDTH];
+	for (int64_t cy = chunkOf(b[1]); cy <= chunkOf(b[3]); cy++) {
+		// spans of the chunk row first, then chunk by chunk
+		int64_t lo = INT64_MAX, hi = INT64_MIN;
+		for (int r = 0; r < CHUNK_WIDTH; r++) {
+			if (!rowSpan(s, cy * CHUNK_WIDTH + r, xa + r, xb + r)) {
+				xa[r] = 1; xb[r] = 0; // empty
+				continue;
+			}
+			lo = min64(lo, xa[r]);
+			hi = max64(hi, xb[r]);
+		}
+		if (lo > hi) continue;
+
+		for (int64_t cx = chunkOf(lo); cx <= chunkOf(hi); cx++) {
+			struct chunk* c = getWorldChunk(cx, cy);
+			if (c == &empty) continue; // requested, not here yet
+			const int64_t gx = cx * CHUNK_WIDTH;
+			int n = 0;
+			for (int r = 0; r < CHUNK_WIDTH; r++) {
+				int64_t a = max64(xa[r], gx), e = min64(xb[r], gx + CHUNK_WIDTH - 1);
+				if (a > e) continue;
+				paintSpan(c, r, a - gx, e - gx, s->paint);
+				n += e - a + 1;
+			}
+			if (n) changedChunk(c);
+			total += n;
+		}
+	}
+	return total;
+}
+
+/*
+ * Scanline flood fill. Only resident chunks are filled, anything else
+ * is a wall, so a fill never loads (or generates) the world around.
+ */
+
+struct fill {
+	struct chunk* c; // last looked up
+	int64_t cx, cy;
+	int target; // material
+};
+
+static uint8_t* fillCell(struct fill* f, int64_t x, int64_t y) {
+	int64_t cx = chunkOf(x), cy = chunkOf(y);
+	if (cx != f->cx || cy != f->cy) {
+		f->c = findChunk(&World.map, cx, cy);
+		f->cx = cx;
+		f->cy = cy;
+	}
+	if (!f->c) return NULL;
+	return getChunkData(f->c, MODE_READ) +
+		(x - cx * CHUNK_WIDTH) + (y - cy * CHUNK_WIDTH) * CHUNK_WIDTH;
+}
+
+static bool fillMatch(struct fill* f, int64_t x, int64_t y) {
+	uint8_t* p = fillCell(f, x, y);
+	return p && (*p >> 2) == f->target;
+}
+
+// row y, x0..x1 inclusive, every cell is resident
+static void fillSpan(int64_t y, int64_t x0, int64_t x1, struct world_paint p) {
+	const int64_t cy = chunkOf(y);
+	for (int64_t cx = chunkOf(x0); cx <= chunkOf(x1); cx++) {
+		struct chunk* c = findChunk(&World.map, cx, cy);
+		const int64_t gx = cx * CHUNK_WIDTH;
+		int64_t a = max64(x0, gx), e = min64(x1, gx + CHUNK_WIDTH - 1);
+		paintSpan(c, y - cy * CHUNK_WIDTH, a - gx, e - gx, p);
+		changedChunk(c);
+	}
+}
+
+struct fseed {
+	int64_t x, y;
+};
+
+static int64_t paintFill(const struct world_shape* s) {
+	struct fill f = {NULL, INT64_MAX, INT64_MAX, 0};
+	uint8_t* seed = fillCell(&f, s->x0, s->y0);
+	if (!seed) return 0;
+	f.target = *seed >> 2;
+	if (!(s->paint.random >> 2) && (s->paint.v >> 2) == f.target) return 0; // no-op
+
+	struct fseed* stack = malloc(FILL_STACK_MAX * sizeof(struct fseed));
+	if (!stack) {
+		perror("NOMEM!");
+		return 0;
+	}
+	int len = 0;
+	int64_t total = 0;
+	stack[len++] = (struct fseed){s->x0, s->y0};
+
+	while (len && total < FILL_MAX) {
+		struct fseed q = stack[--len];
+		if (!fillMatch(&f, q.x, q.y)) continue;
+		int64_t xl = q.x, xr = q.x;
+		while (q.x - xl < SHAPE_SIZE_MAX && fillMatch(&f, xl - 1, q.y)) xl--;
+		while (xr - q.x < SHAPE_SIZE_MAX && fillMatch(&f, xr + 1, q.y)) xr++;
+
+		// seeds : one per run of matching cells above and below
+		for (int d = -1; d <= 1; d += 2) {
+			bool run = false;
+			for (int64_t x = xl; x <= xr; x++) {
+				bool m = fillMatch(&f, x, q.y + d);
+				if (m && !run && len < FILL_STACK_MAX)
+					stack[len++] = (struct fseed){x, q.y + d};
+				run = m;
+			}
+		}
+
+		fillSpan(q.y, xl, xr, s->paint);
+		total += xr - xl + 1;
+	}
+	free(stack);
+	return total;
+}
+
+int64_t paintWorldShape(const struct world_shape* s) {
+	int64_t n = s->kind == SHAPE_FILL ? paintFill(s) : paintConvex(s);
+	PROF_COUNT("edited cells", n);
+	return n;
+}
+
+/*
+ * Region clipboard. Tile packing : control byte c < 128 is followed by
+ * c + 1 literal bytes, otherwise by one byte repeated c - 125 times.
+ */
+
+#define TILE (CHUNK_WIDTH * CHUNK_WIDTH)
+#define RUN_MIN 3
+#define RUN_MAX (255 - 125)
+#define TILE_PACKED_MAX (TILE + TILE / 128) // all literals
+#define PENDING_MAX 64 // pastes waiting for chunks, the rest is dropped
+
+static int packTile(const uint8_t* in, uint8_t* out) {
+	int i = 0, o = 0;
+	while (i < TILE) {
+		int run = 1;
+		while (i + run < TILE && run < RUN_MAX && in[i + run] == in[i]) run++;
+		if (run >= RUN_MIN) {
+			out[o++] = run + 125;
+			out[o++] = in[i];
+			i += run;
+			continue;
+		}
+		int n = 0; // literals, until the next run
+		while (i + n < TILE && n < 128) {
+			if (i + n + 2 < TILE && in[i + n] == in[i + n + 1] && in[i + n] == in[i + n + 2])
+				break;
+			n++;
+		}
+		out[o++] = n - 1;
+		memcpy(out + o, in + i, n);
+		o += n;
+		i += n;
+	}
+	return o;
+}
+
+static void unpackTile(const uint8_t* in, uint8_t* out) {
+	int o = 0;
+	while (o < TILE) {
+		int c = *in++;
+		if (c < 128) {
+			memcpy(out + o, in, c + 1);
+			in += c + 1;
+			o += c + 1;
+		} else {
+			memset(out + o, *in++, c - 125);
+			o += c - 125;
+		}
+	}
+}
+
+static inline const uint8_t* regionTile(const struct world_region* r, int tx, int ty) {
+	return r->data + r->tiles[tx + ty * r->w];
+}
+
+struct world_region* copyWorldRegion(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int* missing) {
+	if (x0 > x1) {int16_t t = x0; x0 = x1; x1 = t;}
+	if (y0 > y1) {int16_t t = y0; y0 = y1; y1 = t;}
+	const int w = x1 - x0 + 1, h = y1 - y0 + 1;
+	if (w > REGION_MAX || h > REGION_MAX) return NULL;
+
+	// worst case first, shrinked at the end
+	const size_t head = sizeof(struct world_region) + (w * h + 1) * sizeof(uint32_t);
+	struct world_region* r = malloc(head + (size_t)w * h * TILE_PACKED_MAX);
+	if (!r) {
+		perror("NOMEM!");
+		return NULL;
+	}
+
+	static const uint8_t air[TILE] = {0};
+	uint32_t* tiles = (uint32_t*)(r + 1);
+	uint8_t* data = (uint8_t*)r + head;
+	uint32_t size = 0;
+	int lost = 0;
+	for (int ty = 0; ty < h; ty++) for (int tx = 0; tx < w; tx++) {
+		struct chunk* c = findChunk(&World.map, x0 + tx, y0 + ty);
+		if (!c) lost++;
+		tiles[tx + ty * w] = size;
+		size += packTile(c ? getChunkData(c, MODE_READ) : air, data + size);
+	}
+	tiles[w * h] = size;
+	if (missing) *missing = lost;
+
+	struct world_region* n = realloc(r, head + size);
+	if (n) r = n;
+	atomic_init(&r->refs, 1);
+	r->w = w;
+	r->h = h;
+	r->size = size;
+	r->tiles = (uint32_t*)(r + 1);
+	r->data = (uint8_t*)r + head;
+	return r;
+}
+
+struct world_region* keepWorldRegion(struct world_region* r) {
+	atomic_fetch_add(&r->refs, 1);
+	return r;
+}
+
+void freeWorldRegion(struct world_region* r) {
+	if (r && atomic_fetch_sub(&r->refs, 1) == 1) free(r);
+}
+
+static void blitRow(uint8_t* dst, const uint8_t* src, int n, bool skip_air) {
+	if (!skip_air) {
+		memcpy(dst, src, n);
+		return;
+	}
+	for (int i = 0; i < n; i++) if (src[i] >> 2) dst[i] = src[i];
+}
+
+// the part of the paste that covers c
+static void pasteChunk(const struct world_paste* p, struct chunk* c) {
+	const struct world_region* r = p->region;
+	const int64_t gx = (int64_t)c->pos.axis[0] * CHUNK_WIDTH;
+	const int64_t gy = (int64_t)c->pos.axis[1] * CHUNK_WIDTH;
+	uint8_t* dst = getChunkData(c, MODE_READ);
+	uint8_t t[TILE];
+
+	if (((p->x | p->y) & (CHUNK_WIDTH - 1)) == 0) { // aligned : one tile
+		const uint8_t* tile = regionTile(r, (gx - p->x) / CHUNK_WIDTH, (gy - p->y) / CHUNK_WIDTH);
+		if (!p->skip_air) unpackTile(tile, dst);
+		else {
+			unpackTile(tile, t);
+			blitRow(dst, t, TILE, true);
+		}
+		changedChunk(c);
+		return;
+	}
+
+	// shifted : up to four tiles
+	for (int64_t ty = chunkOf(gy - p->y); ty <= chunkOf(gy + CHUNK_WIDTH - 1 - p->y); ty++)
+	for (int64_t tx = chunkOf(gx - p->x); tx <= chunkOf(gx + CHUNK_WIDTH - 1 - p->x); tx++) {
+		if (tx < 0 || ty < 0 || tx >= r->w || ty >= r->h) continue;
+		const int64_t sx = p->x + tx * CHUNK_WIDTH, sy = p->y + ty * CHUNK_WIDTH;
+		const int64_t x0 = max64(sx, gx), x1 = min64(sx, gx) + CHUNK_WIDTH - 1;
+		const int64_t y0 = max64(sy, gy), y1 = min64(sy, gy) + CHUNK_WIDTH - 1;
+		unpackTile(regionTile(r, tx, ty), t);
+		for (int64_t y = y0; y <= y1; y++)
+			blitRow(dst + (y - gy) * CHUNK_WIDTH + (x0 - gx),
+				t + (y - sy) * CHUNK_WIDTH + (x0 - sx), x1 - x0 + 1, p->skip_air);
+	}
+	changedChunk(c);
+}
+
+// pastes waiting for their chunks, in paste order. Bit per chunk
+struct pending {
+	struct world_paste paste;
+	int64_t cx, cy; // first chunk
+	int w, h;       // in chunks
+	int left;       // chunks still waiting
+	uint8_t* wait;
+};
+
+static struct pending pending[PENDING_MAX];
+static int pending_len = 0;
+static atomic_int paste_waiting, paste_dropped, paste_pending; // read by the render thread
+
+static struct pending* newPending(const struct world_paste* p, int64_t cx, int64_t cy, int w, int h) {
+	if (pending_len >= PENDING_MAX) return NULL;
+	uint8_t* wait = calloc((w * h + 7) / 8, 1);
+	if (!wait) {
+		perror("NOMEM!");
+		return NULL;
+	}
+	struct pending* q = pending + pending_len++;
+	*q = (struct pending){*p, cx, cy, w, h, 0, wait};
+	atomic_store(&paste_pending, pending_len);
+	keepWorldRegion(p->region);
+	return q;
+}
+
+static void freePending(struct pending* q) {
+	freeWorldRegion(q->paste.region);
+	free(q->wait);
+}
+
+int pasteWorldRegion(const struct world_paste* p) {
+	const struct world_region* r = p->region;
+	const int64_t cx = chunkOf(p->x), cy = chunkOf(p->y);
+	const int w = chunkOf(p->x + r->w * CHUNK_WIDTH - 1) - cx + 1;
+	const int h = chunkOf(p->y + r->h * CHUNK_WIDTH - 1) - cy + 1;
+	struct pending* q = NULL;
+	int dropped = 0;
+	for (int ty = 0; ty < h; ty++) for (int tx = 0; tx < w; tx++) {
+		struct chunk* c = getWorldChunk(cx + tx, cy + ty);
+		if (c != &empty) {
+			pasteChunk(p, c);
+			continue;
+		}
+		// requested, wait for it
+		if (!q && !dropped) q = newPending(p, cx, cy, w, h);
+		if (!q) {
+			dropped++;
+			continue;
+		}
+		const int b = tx + ty * w;
+		q->wait[b >> 3] |= 1 << (b & 7);
+		q->left++;
+	}
+
+	const int left = q ? q->left : 0;
+	atomic_fetch_add(&paste_waiting, left);
+	atomic_fetch_add(&paste_dropped, dropped);
+	PROF_COUNT("pasted chunks", w * h - left - dropped);
+	return left;
+}
+
+// bit of the chunk in the paste, or -1 if paste does not wait for it
+static int waitBit(const struct pending* q, const struct chunk* c) {
+	const int64_t tx = c->pos.axis[0] - q->cx, ty = c->pos.axis[1] - q->cy;
+	if (tx < 0 || ty < 0 || tx >= q->w || ty >= q->h) return -1;
+	const int b = tx + ty * q->w;
+	return q->wait[b >> 3] & (1 << (b & 7)) ? b : -1;
+}
+
+// removes finished pastes, keeps the order
+static void compactPending(void) {
+	int n = 0;
+	for (int i = 0; i < pending_len; i++) {
+		if (pending[i].left) pending[n++] = pending[i];
+		else freePending(pending + i);
+	}
+	pending_len = n;
+	atomic_store(&paste_pending, n);
+}
+
+// paste is applied if arrived, or just forgotten
+static void takeChunk(struct chunk* c, bool arrived) {
+	if (!pending_len) return;
+	bool done = false;
+	for (int i = 0; i < pending_len; i++) {
+		struct pending* q = pending + i;
+		const int b = waitBit(q, c);
+		if (b < 0) continue;
+		q->wait[b >> 3] &= ~(1 << (b & 7));
+		if (arrived) pasteChunk(&q->paste, c);
+		else atomic_fetch_add(&paste_dropped, 1);
+		atomic_fetch_sub(&paste_waiting, 1);
+		if (!--q->left) done = true;
+	}
+	if (done) compactPending();
+}
+
+void pasteArrived(struct chunk* c) {
+	takeChunk(c, true);
+}
+
+bool pasteWaits(const struct chunk* c) {
+	for (int i = 0; i < pending_len; i++)
+		if (waitBit(pending + i, c) >= 0) return true;
+	return false;
+}
+
+void pasteLost(struct chunk* c) {
+	takeChunk(c, false);
+}
+
+void dropPendingPastes(void) {
+	for (int i = 0; i < pending_len; i++) freePending(pending + i);
+	pending_len = 0;
+	atomic_store(&paste_pending, 0);
+	atomic_store(&paste_waiting, 0);
+	atomic_store(&paste_dropped, 0);
+}
+
+void pasteStats(int* pastes, int* waiting, int* dropped) {
+	*pastes  = atomic_load(&paste_pending);
+	*waiting = atomic_load(&paste_waiting);
+	*dropped = atomic_load(&paste_dropped);
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Shape edits. Shapes are rasterized into row spans chunk by chunk :
+ * one lookup and one wake per chunk, memset() for the spans. Chunks
+ * that are not loaded are skipped (and requested), like with
+ * setWorldPixel().
+ *
+ * From the render thread use queueWorldShape() (see simulation.h).
+ */
+
+enum {
+	SHAPE_LINE,   // (x0, y0) - (x1, y1), radius is half of thickness
+	SHAPE_CIRCLE, // center (x0, y0)
+	SHAPE_RECT,   // corners (x0, y0) and (x1, y1), inclusive
+	SHAPE_FILL    // flood fill of the material at (x0, y0), loaded chunks only
+};
+
+#define FILL_MAX (1 << 20) // cells per flood fill
+
+struct world_paint {
+	uint8_t v;      // pixel value
+	uint8_t random; // bits of v that are random for every pixel
+};
+
+struct world_shape {
+	int kind;
+	int64_t x0, y0, x1, y1;
+	int radius;
+	struct world_paint paint;
+};
+
+// world lock must be held (simulation thread). Returns cells painted
+int64_t paintWorldShape(const struct world_shape* s);
+
+/*
+ * Region clipboard. A rectangle of chunks is copied into 16x16 tiles,
+ * every tile packed on it's own (runs and literals, terrain packs
+ * well). Regions don't depend on the world, so they may be pasted into
+ * another one.
+ *
+ * Chunk aligned pastes unpack tiles right into the chunk data, others
+ * are blitted row by row from up to four tiles. Chunks that are not
+ * loaded yet get the paste when they arrive (see saveloadTick()).
+ */
+
+#define REGION_MAX 256 // chunks, per axis
+
+struct world_region {
+	atomic_int refs; // pastes in flight hold their own
+	int w, h;        // in chunks
+	size_t size;     // packed bytes
+	uint32_t* tiles; // offsets in data, w*h + 1
+	uint8_t* data;
+};
+
+struct world_paste {
+	struct world_region* region;
+	int64_t x, y; // top left corner, pixels
+	bool skip_air; // stamp : air of the region keeps what was there
+};
+
+// world lock must be held. Chunks are inclusive. Chunks that are not
+// loaded are copied as air and counted in missing (may be NULL)
+struct world_region* copyWorldRegion(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int* missing);
+
+struct world_region* keepWorldRegion(struct world_region* r); // one more reference
+void freeWorldRegion(struct world_region* r); // drops a reference
+
+// world lock must be held. Returns chunks deferred until they are loaded.
+// Chunks that can't be deferred (too many pastes wait) are dropped
+int pasteWorldRegion(const struct world_paste* p);
+
+// pastes and chunks waiting now, and chunks dropped since the world was
+// opened. No lock needed
+void pasteStats(int* pastes, int* waiting, int* dropped);
+
+struct chunk;
+
+// world lock must be held
+void pasteArrived(struct chunk* c); // chunk is in World.map now
+void dropPendingPastes(void); // world is closed
+
+// world lock must be held. GC keeps load queue chunks alive while a
+// paste waits for them, and forgets them (counted as dropped) if not
+bool pasteWaits(const struct chunk* c);
+void pasteLost(struct chunk* c); // chunk is freed before it was loaded
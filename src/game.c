@@ -89,10 +89,14 @@ bool game_working = true;
 
 void initDToolkit();
 void freeDToolkit();
+void freeClipboard();
 void drawDToolkit();
 bool updateDToolkit();
 
 #include "settings.h"
+#include "sampler.h"
+#include "headless.h"
+#include <string.h>
 
 static void frame(bool should_close) {
 		prof_begin(PROF_FINDRAW);
@@ -153,7 +157,10 @@ Color getPixelColor(uint8_t val) {
 
 
 
-int main() {
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+		return headlessMain(argc, argv);
+
 	prof_register_thread();
 	prof_begin(PROF_INIT_FREE);
 	_initAtoms();
@@ -166,12 +173,14 @@ int main() {
 
 	InitWindow(conf_win_width, conf_win_height, "[PixelBox] : loading");
 	SetWindowState(FLAG_WINDOW_RESIZABLE);
+	setWorldClock(GetTime);
 	GuiLoadStyleDark();
 	initAssetSystem();
 	SetRootScreen(&ScrMainMenu);
 	prof_end();
 
 	initDToolkit();
+	initSampler();
 
 	while (game_working) { //!) { 
 		prof_begin(PROF_GAMETICK);
@@ -179,12 +188,15 @@ int main() {
 		prof_end();
 
 		prof_step();
+		if (samplerRunning()) processSampler();
 	};
 	
 	// free screen
 	if (SCREEN && SCREEN->destroy) SCREEN->destroy();
 
 	freeDToolkit();
+	freeClipboard();
+	freeSampler();
 
 	conf_win_width = GetScreenWidth();
 	conf_win_height = GetScreenHeight();
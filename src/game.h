@@ -20,6 +20,9 @@
 
 void initBuilder();
 void freeBuilder();
+float minZoom(void); // of the camera, depends on the screen size
+
+#define MIN_ZOOM 0.25
 void flushChunksCache();
 int  renderChunk(struct chunk* c);
 
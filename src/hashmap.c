@@ -1,5 +1,6 @@
 // see pixelbox.h for copyright notice and license.
 #include "implix.h"
+#include "edit.h"
 #include <stdlib.h>
 
 static inline struct chunk** next(struct chunk* c, bool g) {
@@ -56,6 +57,10 @@ struct chunk* removeChunk(struct chunkmap* m, struct chunk* c) {
 void collectAnything (void) {
 
 	for (int i = 0; i < MAPLEN; i++) {
+		for (struct chunk* c = World.update.data[i]; c; c = c->next2) {
+			c->wake_on_load = 1; // see addSaveQueue()
+			c->is_changed = 1;
+		}
 		World.update.data[i] = NULL; // yeah...
 	}
 
@@ -71,9 +76,11 @@ void collectAnything (void) {
 }
 
 #include <assert.h>
+#include "profiler.h"
 
 int collectGarbage (void) {
 	int limit = 0;
+	int resident = 0, loading = 0;
 
 	// collect general
 	for (int i = 0; i < MAPLEN; i++) {
@@ -91,6 +98,7 @@ int collectGarbage (void) {
 			} else {
 				old = c;
 				c = c->next;
+				resident++;
 			}
 		}
 		// OK
@@ -104,6 +112,8 @@ int collectGarbage (void) {
 		struct chunk *c = World.load.data[i], *old = NULL;
 		while (c) {
 			if (c->usagefactor >= 0) c->usagefactor--;
+			if (c->usagefactor < 0 && pasteWaits(c)) // loading may be slow
+				c->usagefactor = CHUNK_USAGE_VALUE;
 			if (c->usagefactor < 0) { // REMOVE AND COLLECT
 				struct chunk* f = c;
 				// next2, since load is minor hashmap!
@@ -111,16 +121,20 @@ int collectGarbage (void) {
 				else World.load.data[i] = c->next2; // remove
 				c = c->next2;
 				// old stays the same
+				pasteLost(f);
 				freeChunk(f); // remove it NOW!
 				limit++;
 			} else {
 				old = c;
 				c = c->next2;
+				loading++;
 			}
 		}
 		// OK
 	}
 
+	PROF_GAUGE("resident chunks", resident);
+	PROF_GAUGE("load queue", loading);
 	return 0;
 }
 
@@ -0,0 +1,222 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "implix.h"
+#include "headless.h"
+#include "profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Headless simulation : no window, no GL, no GetTime().
+ *
+ * World clock is a tick counter, and every headlessTick() advances it by
+ * exactly one simulation tick. Chunks in the view rectangle are kept
+ * alive, like renderer does, and are woken up (put into the update
+ * queue) once, when they are loaded. Everything else is up to the
+ * simulation itself.
+ */
+
+static struct {
+	uint64_t ticks;
+	struct headless_view view;
+	uint8_t* woken; // per view chunk
+} Headless;
+
+static double tickClock(void) {
+	return Headless.ticks / (double)WORLD_TPS; // exact, TPS is pow of 2
+}
+
+static int viewWidth(const struct headless_view* v) {
+	return v->x1 - v->x0 + 1;
+}
+
+static int viewHeight(const struct headless_view* v) {
+	return v->y1 - v->y0 + 1;
+}
+
+bool initHeadless(struct headless_view view) {
+	if (view.x1 < view.x0 || view.y1 < view.y0) return false;
+	Headless.view  = view;
+	Headless.ticks = 0;
+	Headless.woken = calloc(viewWidth(&view) * viewHeight(&view), 1);
+	if (!Headless.woken) {
+		perror("NOMEM!");
+		return false;
+	}
+	setWorldClock(tickClock);
+	World.is_update_enabled = true;
+	return true;
+}
+
+void freeHeadless() {
+	free(Headless.woken);
+	Headless.woken = NULL;
+	setWorldClock(NULL);
+}
+
+uint64_t headlessTicks() {
+	return Headless.ticks;
+}
+
+void headlessTick() {
+	const struct headless_view* v = &Headless.view;
+	Headless.ticks++;
+
+	// keep view alive, wake up newcomers
+	for (int y = v->y0; y <= v->y1; y++) {
+		for (int x = v->x0; x <= v->x1; x++) {
+			struct chunk* c = getWorldChunk(x, y);
+			uint8_t* woken = Headless.woken +
+				(x - v->x0) + (y - v->y0) * viewWidth(v);
+			if (c == &empty || *woken) continue;
+			markWorldUpdate((int64_t)x * CHUNK_WIDTH, (int64_t)y * CHUNK_WIDTH);
+			*woken = 1;
+		}
+	}
+
+	prof_begin(PROF_UPDATE);
+	updateWorld();
+	prof_end();
+
+	prof_begin(PROF_LOAD_SAVE);
+	saveloadTick();
+	prof_end();
+
+	prof_begin(PROF_GC);
+	collectGarbage();
+	prof_end();
+}
+
+// waits until every chunk of the view is loaded. Returns false on timeout
+bool headlessWaitView(int max_iterations) {
+	const struct headless_view* v = &Headless.view;
+	for (int i = 0; i < max_iterations; i++) {
+		bool ready = true;
+		for (int y = v->y0; y <= v->y1; y++)
+			for (int x = v->x0; x <= v->x1; x++)
+				if (getWorldChunk(x, y) == &empty) ready = false;
+		if (ready) return true;
+		saveloadTick();
+	}
+	return false;
+}
+
+void headlessFill(int64_t x0, int64_t y0, int64_t x1, int64_t y1, uint8_t v) {
+	for (int64_t y = y0; y < y1; y++)
+		for (int64_t x = x0; x < x1; x++)
+			setWorldPixel(x, y, v ^ ((x ^ y) & 1), MODE_READ);
+
+	for (int64_t y = y0; y < y1; y += CHUNK_WIDTH)
+		for (int64_t x = x0; x < x1; x += CHUNK_WIDTH)
+			markWorldUpdate(x, y);
+}
+
+int headlessResident() {
+	int n = 0;
+	for (int i = 0; i < MAPLEN; i++)
+		for (struct chunk* c = World.map.data[i]; c; c = c->next) n++;
+	return n;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr,
+		"usage : %s --headless [options]\n"
+		"  --world PATH          world database (default :memory:)\n"
+		"  --ticks N             simulation ticks to run (default 640)\n"
+		"  --view X0,Y0,X1,Y1    kept alive area, in chunks (default -4,-4,4,4)\n"
+		"  --seed N              world seed (new worlds)\n"
+		"  --mode N              worldgen mode (new worlds)\n"
+		"  --water 0|1           water leveling solver (default 0)\n", name);
+}
+
+int headlessMain(int argc, char** argv) {
+	const char* path = ":memory:";
+	long long ticks = 640;
+	struct headless_view view = {-4, -4, 4, 4};
+	bool has_seed = false, has_mode = false, water = false;
+	long long seed = 0;
+	int mode = 0;
+
+	for (int i = 1; i < argc; i++) {
+		const char* a = argv[i];
+		const char* next = i + 1 < argc ? argv[i + 1] : NULL;
+		if (strcmp(a, "--headless") == 0) continue;
+		if (!next) {
+			usage(argv[0]);
+			return 1;
+		}
+		if (strcmp(a, "--world") == 0) path = next;
+		else if (strcmp(a, "--ticks") == 0) ticks = atoll(next);
+		else if (strcmp(a, "--seed") == 0) {
+			seed = atoll(next);
+			has_seed = true;
+		} else if (strcmp(a, "--mode") == 0) {
+			mode = atoi(next);
+			has_mode = true;
+		} else if (strcmp(a, "--water") == 0) {
+			water = atoi(next) != 0;
+		} else if (strcmp(a, "--view") == 0) {
+			if (sscanf(next, "%i,%i,%i,%i", &view.x0, &view.y0, &view.x1, &view.y1) != 4) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+
+	prof_register_thread();
+	initWorld();
+	openWorld(path);
+	int64_t stored;
+	if (loadProperty("seed", &stored)) { // existing world keeps it's own
+		if (has_seed || has_mode)
+			fprintf(stderr, "%s exists, --seed and --mode are ignored\n", path);
+	} else {
+		if (has_seed) setWorldSeed(seed);
+		if (has_mode) World.mode = mode;
+	}
+	World.water_solver = water;
+
+	if (!initHeadless(view)) {
+		fprintf(stderr, "bad view rectangle!\n");
+		freeWorld();
+		prof_unregister_thread();
+		return 1;
+	}
+
+	uint64_t start = prof_clock();
+	for (long long i = 0; i < ticks; i++) {
+		headlessTick();
+		prof_step();
+	}
+	double secs = (prof_clock() - start) / 1e9;
+
+	World.playtime += ticks / WORLD_TPS;
+	printf("world %s : %lli ticks in %.3f s (%.1f ticks/s), %i chunks resident\n",
+		path, ticks, secs, secs > 0 ? ticks / secs : 0.0, headlessResident());
+
+	freeHeadless();
+	freeWorld();
+	prof_unregister_thread();
+	return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Fixed step simulation without a window.
+ * World must be initialized and opened before initHeadless().
+ */
+
+struct headless_view { // in chunks, inclusive
+	int x0, y0, x1, y1;
+};
+
+bool initHeadless(struct headless_view view); // sets the world clock!
+void freeHeadless();
+
+// one simulation tick + load/save/GC. Thread must be registered in profiler
+void headlessTick();
+uint64_t headlessTicks();
+
+// loads (or generates) the whole view right now
+bool headlessWaitView(int max_iterations);
+
+int headlessResident(); // chunks in World.map
+
+// fixtures for tests and benchmarks. Flat world (mode 1) has a floor at
+// y = 64. Fills a rectangle (in pixels, x1 and y1 exclusive) and wakes
+// it up, lowest bit (color variant, direction for water) is mixed a bit.
+// Chunks must be loaded
+void headlessFill(int64_t x0, int64_t y0, int64_t x1, int64_t y1, uint8_t v);
+
+// pixelbox --headless ... (see usage)
+int headlessMain(int argc, char** argv);
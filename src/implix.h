@@ -71,6 +71,7 @@ void saveChunk(struct chunk*); // directly!
 
 void addSaveQueue(struct chunk*); // FREES CHUNK AT THE END!!!
 void addLoadQueue(struct chunk*); // INSERTS CHUNK IN THE TABLE AT THE END!
+void wakeChunk(struct chunk*); // back in World.map, put it in the update queue
 
 struct sqlite3_stmt;
 struct sqlite3_stmt* create_statement(sqlite3* db, const char* sql);
@@ -82,3 +83,13 @@ void insertChunk(struct chunkmap* m, struct chunk* c);
 struct chunk* removeChunk(struct chunkmap* m, struct chunk* c); // returns next chunk if avail.
 
 bool updateChunk(struct chunk* c, const int);
+
+void queueMinimap(struct chunk* c);
+
+// call this on every change of the chunk content!
+// Versions are taken from the global clock, so a chunk reloaded from
+// disk never gets the same version as it had before unloading.
+static inline void touchChunk(struct chunk* c) {
+	c->version = ++World.version;
+	if (!c->in_minimap) queueMinimap(c);
+}
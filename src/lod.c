@@ -0,0 +1,165 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "lod.h"
+#include "implix.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LOD_HASHLEN (1 << 16) // must be pow of 2!
+#define LOD_MAX     VIEW_MAX // entries in the cache (up to ~60 MB)
+#define LOD_RETRY   120 // frames between load requests of the same chunk
+#define LOD_REQUESTS_PER_FRAME 64
+
+static struct lodentry* lodmap[LOD_HASHLEN] = {0};
+static int lodcount = 0;
+static int requests = 0;
+static uint32_t request_frame = 0;
+
+#define LODHASH(V) (hash_function(V) & (LOD_HASHLEN-1))
+
+void initLod(void) {
+	freeLod();
+}
+
+void freeLod(void) {
+	for (int i = 0; i < LOD_HASHLEN; i++) {
+		struct lodentry* e = lodmap[i];
+		while (e) {
+			struct lodentry* f = e;
+			e = e->next;
+			free(f);
+		}
+		lodmap[i] = NULL;
+	}
+	lodcount = 0;
+}
+
+int getLodCount(void) {
+	return lodcount;
+}
+
+// most frequent value in the n*n block. Ties go to the first one
+static uint8_t pickValue(const uint8_t* d, int pitch, int n) {
+	uint8_t best = d[0];
+	int bestcnt = 0;
+	for (int i = 0; i < n*n; i++) {
+		uint8_t v = d[(i / n) * pitch + i % n];
+		int cnt = 0;
+		for (int j = 0; j < n*n; j++) {
+			cnt += d[(j / n) * pitch + j % n] == v;
+		}
+		if (cnt > bestcnt) {
+			best = v;
+			bestcnt = cnt;
+		}
+	}
+	return best;
+}
+
+static void summarize(struct lodentry* e, struct chunk* c) {
+	const uint8_t* data = getChunkData(c, MODE_READ);
+	const int w1 = CHUNK_WIDTH/2, w2 = CHUNK_WIDTH/4;
+
+	for (int y = 0; y < w1; y++) {
+		for (int x = 0; x < w1; x++) {
+			e->lod1[x + y * w1] = pickValue(
+				data + x*2 + y*2*CHUNK_WIDTH, CHUNK_WIDTH, 2);
+		}
+	}
+
+	// next level is made from the previous one
+	for (int y = 0; y < w2; y++) {
+		for (int x = 0; x < w2; x++) {
+			e->lod2[x + y * w2] = pickValue(e->lod1 + x*2 + y*2*w1, w1, 2);
+		}
+	}
+
+	e->version = c->version;
+	e->known = true;
+}
+
+struct lodentry* getLod(int16_t x, int16_t y, uint32_t frame) {
+	union packpos pos;
+	pos.axis[0] = x;
+	pos.axis[1] = y;
+
+	uint32_t i = LODHASH(pos.pack);
+	struct lodentry* e = lodmap[i];
+	while (e && e->pos.pack != pos.pack) e = e->next;
+
+	// NOT getWorldChunk() : we don't want to pin it
+	struct chunk* c = findChunk(&World.map, x, y);
+
+	if (!e) {
+		if (lodcount >= LOD_MAX) return NULL; // wait for collectLod()
+		e = calloc(1, sizeof(struct lodentry));
+		if (!e) return NULL;
+		e->pos = pos;
+		e->requested = frame - LOD_RETRY;
+		e->next = lodmap[i];
+		lodmap[i] = e;
+		lodcount++;
+	}
+	e->seen = frame;
+
+	if (c) {
+		if (!e->known || e->version != c->version) summarize(e, c);
+		return e;
+	}
+
+	if (e->known) return e; // chunk is gone, but we remember it :)
+
+	// ask to load it once in a while, and not too much at once.
+	// It will be unloaded by GC later, since nobody touches it.
+	if (request_frame != frame) {
+		request_frame = frame;
+		requests = 0;
+	}
+	if (frame - e->requested >= LOD_RETRY && requests < LOD_REQUESTS_PER_FRAME) {
+		getWorldChunk(x, y);
+		e->requested = frame;
+		requests++;
+	}
+	return e;
+}
+
+static void dropOlder(uint32_t frame, uint32_t age) {
+	for (int i = 0; i < LOD_HASHLEN; i++) {
+		struct lodentry *e = lodmap[i], *old = NULL;
+		while (e) {
+			if (frame - e->seen >= age) {
+				struct lodentry* f = e;
+				if (old) old->next = e->next;
+				else lodmap[i] = e->next;
+				e = e->next;
+				free(f);
+				lodcount--;
+			} else {
+				old = e;
+				e = e->next;
+			}
+		}
+	}
+}
+
+void collectLod(uint32_t frame) {
+	if (lodcount < LOD_MAX) return;
+	dropOlder(frame, 600); // not seen for ~10 seconds
+	if (lodcount >= LOD_MAX/2) dropOlder(frame, 1); // anything offscreen
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include "pixel.h"
+
+/*
+ * Level of detail pyramid for zoomed out views.
+ *
+ * For every chunk that was seen from far away, we keep it's downsampled
+ * summaries : 8x8 (level 1, every pixel is a 2x2 block) and 4x4 (level 2,
+ * 4x4 blocks, made from level 1). Summaries are rebuilt only when the
+ * version of the resident chunk changes, and they stay in the cache after
+ * chunk is unloaded, so zoomed out views don't keep every chunk in memory.
+ */
+
+#define LOD_LEVELS 2
+
+/*
+ * Most chunks, that one view may have. Covers a 4K screen at the minimal
+ * zoom (~521k chunks), bigger screens get a bigger minimal zoom instead,
+ * see minZoom(). The LOD cache and the render pools are sized from it.
+ */
+#define VIEW_MAX (1 << 19)
+
+struct lodentry {
+	struct lodentry* next;
+	union packpos pos;
+	uint32_t version;   // of the chunk summary was made from
+	uint32_t seen;      // frame, when entry was used last time
+	uint32_t requested; // frame, when chunk load was requested
+	bool known;         // summaries are valid
+	uint8_t lod1[(CHUNK_WIDTH/2)*(CHUNK_WIDTH/2)];
+	uint8_t lod2[(CHUNK_WIDTH/4)*(CHUNK_WIDTH/4)];
+};
+
+void initLod(void);
+void freeLod(void);
+
+// tile width of the level in pixels
+static inline int lodTileWidth(int level) {
+	return CHUNK_WIDTH >> level;
+}
+
+static inline const uint8_t* lodTile(struct lodentry* e, int level) {
+	return level == 1 ? e->lod1 : e->lod2;
+}
+
+/*
+ * Returns summary entry of the chunk, updated from the resident chunk if
+ * needed. Not resident chunks are requested to load (rarely), but never
+ * kept in memory by this function. May return NULL or unknown entry.
+ */
+struct lodentry* getLod(int16_t x, int16_t y, uint32_t frame);
+
+// drops entries that were not seen for a long time, if cache is too big
+void collectLod(uint32_t frame);
+
+int getLodCount(void);
@@ -0,0 +1,253 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <raylib.h>
+#include "implix.h"
+#include "game.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * Minimap : one texel per chunk.
+ *
+ * Average color of every chunk we have ever seen is kept in the sparse
+ * grid of regions (REGION_WIDTH*REGION_WIDTH chunks each). Chunks are
+ * queued for recalculation by touchChunk(), so the grid is updated only
+ * when chunk content changes. Chunks that were never loaded are guessed
+ * with softGenerate(). Nothing here loads chunks at all.
+ */
+
+#define REGION_SHIFT  5
+#define REGION_WIDTH  (1 << REGION_SHIFT) // in chunks
+#define MINIMAP_SIZE  128 // in chunks (texels)
+#define MINIMAP_SCALE 1.5
+#define MINIMAP_REBUILD 8 // frames between texture rebuilds (at most)
+#define QUEUE_MAX (1 << 16)
+
+// alpha of the cell color says what do we know about it
+#define CELL_SOFT 128 // guessed by softGenerate()
+#define CELL_REAL 255 // real average
+
+struct mmregion {
+	struct mmregion* next;
+	union packpos pos; // in regions
+	Color cells[REGION_WIDTH*REGION_WIDTH];
+};
+
+static struct {
+	struct mmregion* map[MINILEN];
+	union packpos* queue;
+	int queuelen, queuecap;
+	Color lut[256];
+	Color pixels[MINIMAP_SIZE*MINIMAP_SIZE];
+	Texture texture;
+	int32_t cx, cy; // center of the last built image, in chunks
+	int frame;
+	int regions;
+	bool dirty; // something has changed since last build
+	bool enabled;
+} Minimap;
+
+void initMinimap() {
+	for (int i = 0; i < 256; i++)
+		Minimap.lut[i] = getPixelColor(i);
+
+	Image img = GenImageColor(MINIMAP_SIZE, MINIMAP_SIZE, BLACK);
+	Minimap.texture = LoadTextureFromImage(img);
+	UnloadImage(img);
+	SetTextureFilter(Minimap.texture, TEXTURE_FILTER_POINT);
+
+	Minimap.dirty = true;
+	Minimap.enabled = true;
+}
+
+void freeMinimap() {
+	for (int i = 0; i < MINILEN; i++) {
+		struct mmregion* r = Minimap.map[i];
+		while (r) {
+			struct mmregion* f = r;
+			r = r->next;
+			free(f);
+		}
+		Minimap.map[i] = NULL;
+	}
+	free(Minimap.queue);
+	Minimap.queue = NULL;
+	Minimap.queuelen = Minimap.queuecap = 0;
+	Minimap.regions = 0;
+	Minimap.enabled = false;
+	UnloadTexture(Minimap.texture);
+}
+
+// called from touchChunk(), when chunk is not queued yet
+void queueMinimap(struct chunk* c) {
+	if (!Minimap.enabled) return;
+	if (Minimap.queuelen >= Minimap.queuecap) {
+		if (Minimap.queuecap >= QUEUE_MAX) return; // will be catched later
+		int cap = Minimap.queuecap ? Minimap.queuecap * 2 : 256;
+		union packpos* q = realloc(Minimap.queue, cap * sizeof(union packpos));
+		if (!q) return;
+		Minimap.queue = q;
+		Minimap.queuecap = cap;
+	}
+	Minimap.queue[Minimap.queuelen++] = c->pos;
+	c->in_minimap = 1;
+}
+
+static struct mmregion* getRegion(int16_t rx, int16_t ry) {
+	union packpos pos;
+	pos.axis[0] = rx;
+	pos.axis[1] = ry;
+
+	uint32_t i = hash_function(pos.pack) & (MINILEN - 1);
+	struct mmregion* r = Minimap.map[i];
+	while (r) {
+		if (r->pos.pack == pos.pack) return r;
+		r = r->next;
+	}
+
+	r = malloc(sizeof(struct mmregion));
+	if (!r) return NULL;
+	r->pos = pos;
+
+	// guess everything, until we know better
+	for (int j = 0; j < REGION_WIDTH*REGION_WIDTH; j++) {
+		int16_t x = rx * REGION_WIDTH + j % REGION_WIDTH;
+		int16_t y = ry * REGION_WIDTH + j / REGION_WIDTH;
+		r->cells[j] = Minimap.lut[softGenerate(x, y)];
+		r->cells[j].a = CELL_SOFT;
+	}
+
+	r->next = Minimap.map[i];
+	Minimap.map[i] = r;
+	Minimap.regions++;
+	return r;
+}
+
+static Color* getCell(int16_t x, int16_t y) {
+	struct mmregion* r = getRegion(x >> REGION_SHIFT, y >> REGION_SHIFT);
+	if (!r) return NULL;
+	return r->cells + (x & (REGION_WIDTH-1)) + (y & (REGION_WIDTH-1))*REGION_WIDTH;
+}
+
+static Color averageColor(struct chunk* c) {
+	const uint8_t* data = getChunkData(c, MODE_READ);
+	int r = 0, g = 0, b = 0;
+	for (int i = 0; i < CHUNK_WIDTH*CHUNK_WIDTH; i++) {
+		Color p = Minimap.lut[data[i]];
+		r += p.r; g += p.g; b += p.b;
+	}
+	const int n = CHUNK_WIDTH*CHUNK_WIDTH;
+	return (Color){r / n, g / n, b / n, CELL_REAL};
+}
+
+// recalculates queued chunks. Call after world update, before GC
+void processMinimap() {
+	for (int i = 0; i < Minimap.queuelen; i++) {
+		union packpos pos = Minimap.queue[i];
+		struct chunk* c = findChunk(&World.map, pos.axis[0], pos.axis[1]);
+		if (!c) continue; // gone already
+		c->in_minimap = 0;
+
+		Color* cell = getCell(pos.axis[0], pos.axis[1]);
+		if (!cell) continue;
+		*cell = averageColor(c);
+		Minimap.dirty = true;
+	}
+	Minimap.queuelen = 0;
+}
+
+static void rebuildMinimap(int32_t cx, int32_t cy) {
+	const int half = MINIMAP_SIZE/2;
+	for (int j = 0; j < MINIMAP_SIZE; j++) {
+		for (int i = 0; i < MINIMAP_SIZE; i++) {
+			Color* cell = getCell(cx - half + i, cy - half + j);
+			Color  col  = cell ? *cell : BLACK;
+			if (col.a != CELL_REAL) { // make guesses darker
+				col.r /= 2; col.g /= 2; col.b /= 2;
+			}
+			col.a = 255;
+			Minimap.pixels[i + j * MINIMAP_SIZE] = col;
+		}
+	}
+	UpdateTexture(Minimap.texture, Minimap.pixels);
+	Minimap.cx = cx;
+	Minimap.cy = cy;
+	Minimap.dirty = false;
+}
+
+static Rectangle minimapRec() {
+	const float size = MINIMAP_SIZE * MINIMAP_SCALE;
+	return (Rectangle) {GetScreenWidth() - size - 10, 30, size, size};
+}
+
+static void cameraChunk(Camera2D cam, int32_t* x, int32_t* y) {
+	*x = floorf(cam.target.x / CHUNK_WIDTH);
+	*y = floorf(cam.target.y / CHUNK_WIDTH);
+}
+
+// returns true, if mouse is over the minimap. Click moves camera there
+bool updateMinimap(Camera2D* cam) {
+	Rectangle rec = minimapRec();
+	Vector2 mouse = GetMousePosition();
+	if (!CheckCollisionPointRec(mouse, rec)) return false;
+
+	if (IsMouseButtonDown(0)) {
+		float tx = (mouse.x - rec.x) / MINIMAP_SCALE - MINIMAP_SIZE/2;
+		float ty = (mouse.y - rec.y) / MINIMAP_SCALE - MINIMAP_SIZE/2;
+		cam->target.x = (Minimap.cx + tx) * CHUNK_WIDTH;
+		cam->target.y = (Minimap.cy + ty) * CHUNK_WIDTH;
+	}
+	return true;
+}
+
+void drawMinimap(Camera2D cam) {
+	int32_t cx, cy;
+	cameraChunk(cam, &cx, &cy);
+
+	Minimap.frame++;
+	if ((Minimap.dirty || cx != Minimap.cx || cy != Minimap.cy) &&
+			Minimap.frame >= MINIMAP_REBUILD) {
+		rebuildMinimap(cx, cy);
+		Minimap.frame = 0;
+	}
+
+	Rectangle rec = minimapRec();
+	DrawTexturePro(Minimap.texture,
+		(Rectangle){0, 0, MINIMAP_SIZE, MINIMAP_SIZE}, rec,
+		(Vector2){0, 0}, 0, WHITE);
+	DrawRectangleLinesEx(rec, 1, GRAY);
+
+	// visible area
+	Vector2 a = GetScreenToWorld2D((Vector2){0, 0}, cam);
+	Vector2 b = GetScreenToWorld2D(
+		(Vector2){GetScreenWidth(), GetScreenHeight()}, cam);
+	float ox = rec.x + (MINIMAP_SIZE/2 - Minimap.cx) * MINIMAP_SCALE;
+	float oy = rec.y + (MINIMAP_SIZE/2 - Minimap.cy) * MINIMAP_SCALE;
+	Rectangle view = {
+		ox + a.x / CHUNK_WIDTH * MINIMAP_SCALE,
+		oy + a.y / CHUNK_WIDTH * MINIMAP_SCALE,
+		(b.x - a.x) / CHUNK_WIDTH * MINIMAP_SCALE,
+		(b.y - a.y) / CHUNK_WIDTH * MINIMAP_SCALE
+	};
+
+	BeginScissorMode(rec.x, rec.y, rec.width, rec.height);
+	DrawRectangleLinesEx(view, 1, YELLOW);
+	EndScissorMode();
+}
@@ -25,8 +25,40 @@ struct updater {
 	uint8_t v;
 };
 
+#define LOD_WALL (4 << 2) // solid, what active chunks see in inactive ones
+#define LOD_CATCHUP_MAX 2 // far ring steps per rate ticks
+static int lod_mask = ~0; // rings that are ticked in the current step
+static int lod_substep = 0; // catch-up step of the far ring in this tick
+
+void setWorldView(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+	World.lod.x0 = x0;
+	World.lod.y0 = y0;
+	World.lod.x1 = x1;
+	World.lod.y1 = y1;
+	World.lod.enabled = true;
+}
+
+void setWorldLod(int near, int far, int rate) {
+	World.lod.near = near > 0 ? near : 0;
+	World.lod.far  = far > World.lod.near ? far : World.lod.near;
+	World.lod.rate = rate > 1 ? rate : 1;
+}
+
+void clearWorldView(void) {
+	World.lod.enabled = false;
+}
+
+static inline bool chunkActive(const struct chunk* c) {
+	return lod_mask & (1 << chunkLodRing(c->pos.axis[0], c->pos.axis[1]));
+}
+
 // (very) slow path
 static inline uint8_t _getpixel(int64_t x, int64_t y) {
+	if (World.lod.enabled) { // don't let anything in or out of sleepers
+		int16_t cx = (uint64_t)x/CHUNK_WIDTH;
+		int16_t cy = (uint64_t)y/CHUNK_WIDTH;
+		if (!(lod_mask & (1 << chunkLodRing(cx, cy)))) return LOD_WALL;
+	}
 	return getWorldPixel(x, y, MODE_READ);
 }
 
@@ -61,232 +93,482 @@ void _initAtoms() {
 	
 }
 
-#define IS_AIR(V) ((V>>2) == 0)
-#define IS_SOLID(V) ((V>>2) % 4 == 0)
-#define IS_SAND(V)  ((V>>2) % 4 == 1)
-#define IS_WATER(V) ((V>>2) % 4 == 2)
-#define IS_SPECI(V) ((V>>2) % 4 == 3)
+/*
+ * Material rules live in tools/materials.lua, and are compiled into
+ * lookup tables and per stage kernels (materials-generated.h) by
+ * tools/matgen. Kernels are specialized for every stage, so there is
+ * no stage switch and no material dispatch per pixel.
+ */
+#define MAT_KERNELS
+#include "materials-generated.h"
 
-static void processor(struct updater* u, const int stage) {
-	uint8_t atom = 0;
+#define IS_AIR(V)     (mat_flags[V] & MAT_EMPTY)
+#define IS_GRAVITY(V) (mat_flags[V] & MAT_GRAVITY)
+#define IS_PILE(V)    (mat_flags[V] & MAT_PILE)
+#define IS_FLOW(V)    (mat_flags[V] & MAT_FLOW)
 
-	switch (stage) {
-		case 0 :
-		if (IS_AIR(u->v)) { // air
-			atom = getpixel(u, u->x, u->y - 1); // get above us
-	
-			if (IS_SAND(atom) || IS_WATER(atom)) {
-				u->v = atom; // swap
-				markUpdate(u, u->x, u->y - 1); // mark chunk-sender
-				return;
-			}
+#define STAGE_PASS(N, KERNEL) \
+static int stagePass##N(struct chunk* c, const uint8_t* read, uint8_t* writ) { \
+	struct updater u = {c, 0, 0, 0}; /* local, or it is reloaded after every write */ \
+	int changed = 0; \
+	for (u.y = 0; u.y < CHUNK_WIDTH; u.y++) { \
+		for (u.x = 0; u.x < CHUNK_WIDTH; u.x++) { \
+			const uint8_t v = read[u.x + u.y * CHUNK_WIDTH]; \
+			u.v = v; \
+			KERNEL(&u); \
+			changed += u.v != v; \
+			writ[u.x + u.y * CHUNK_WIDTH] = u.v; \
+		} \
+	} \
+	return changed; \
+}
 
-		} else if (IS_SAND(u->v) || IS_WATER(u->v)) { // sand
-			atom = getpixel(u, u->x, u->y + 1); // get under us
-	
-			if (IS_AIR(atom)) {
-				u->v = atom; // swap
-				markUpdate(u, u->x, u->y + 1); // mark chunk-reciever
-				return;
-			}
+MAT_FOR_STAGES(STAGE_PASS)
+
+#define STAGE_ENTRY(N, KERNEL) stagePass##N,
+static int (*const stage_passes[MAT_STAGES])(struct chunk*, const uint8_t*, uint8_t*) = {
+	MAT_FOR_STAGES(STAGE_ENTRY)
+};
+
+bool updateChunk(struct chunk* c, const int stage) {
+	int changed = stage_passes[stage](c, getChunkData(c, MODE_READ), getChunkData(c, MODE_WRITE));
+	c->changes += changed;
+	return changed != 0;
+}
+
+#include <string.h>
+#include "profiler.h"
+#include "water.h"
+
+#define MIN_TICK (1.0/(double)WORLD_TPS)
+#define MAX_LAG 0.25 // seconds of lag we are willing to catch up on
+static double old_time = 0.0;
+static double (*world_clock)(void) = NULL;
+
+/*
+ * Fixed timestep scheduler. Clock time is put into the accumulator, and
+ * whole ticks are taken from it. One updateWorld() call does not run more
+ * than max_ticks ticks, and stops earlier if it runs out of time budget,
+ * so a stall (save, GC spike, ...) does not turn into a bigger stall.
+ * Whatever is left is the simulation lag, it is caught up on in next
+ * frames. Lag above MAX_LAG is dropped : we slow down instead of dying.
+ */
+static struct {
+	double accum;
+	int max_ticks;
+	double budget;
+	struct world_sched stat;
+} Sched = {.max_ticks = 4, .budget = 1.0/120.0};
+
+void setWorldClock(double (*clock)(void)) {
+	world_clock = clock;
+	old_time = clock ? clock() : 0.0;
+	Sched.accum = 0.0;
+	Sched.stat.lag = Sched.stat.alpha = 0.0;
+}
+
+void setWorldSchedLimits(int max_ticks, double budget) {
+	Sched.max_ticks = max_ticks > 0 ? max_ticks : 1;
+	Sched.budget = budget;
+}
+
+const struct world_sched* getWorldSched(void) {
+	return &Sched.stat;
+}
+
+/*
+ * Simulation heat of chunks, for the debug overlay : time spent on their
+ * updates and cells changed. Both are halved every second, so they are
+ * about twice the cost per second, and hot chunks cool down when idle.
+ */
+static inline void heatChunk(struct chunk* c, uint64_t start) {
+	uint64_t cost = c->cost + (prof_clock() - start);
+	c->cost = cost > UINT32_MAX ? UINT32_MAX : cost;
+}
+
+static void coolChunks(void) {
+	for (int i = 0; i < MAPLEN; i++) {
+		for (struct chunk* c = World.map.data[i]; c; c = c->next) {
+			c->cost >>= 1;
+			c->changes >>= 1;
 		}
-		break;
-		case 1:
-		if (IS_AIR(u->v)) { // air
-			atom = getpixel(u, u->x-1, u->y);
-	
-			if (IS_SAND(atom) && IS_SAND(getpixel(u, u->x-1, u->y-1))) {
-				u->v = atom; // swap
-				markUpdate(u, u->x-1, u->y); // mark chunk-sender
-				return;
-			}
+	}
+}
 
-			int dir = (atom & 1)*2-1;
-			if (IS_WATER(atom) && !IS_AIR(getpixel(u, u->x-dir, u->y+1))) {
-				u->v = atom; // swap
-				markUpdate(u, u->x-dir, u->y); // mark chunk-sender
-				return;
-			}
-	
-		} else if (IS_SAND(u->v) && IS_SAND(getpixel(u, u->x, u->y-1))) {
-			atom = getpixel(u, u->x+1, u->y); 
-	
-			if (IS_AIR(atom)) {
-				u->v = atom; // swap
-				markUpdate(u, u->x+1, u->y); // mark chunk-reciever
-				return;
-			}
-		} else if (IS_WATER(u->v) && !IS_AIR(getpixel(u, u->x, u->y+1))) {
-			int dir = (u->v & 1)*2-1;
-			atom = getpixel(u, u->x+dir, u->y); 
-	
-			if (IS_AIR(atom)) {
-				u->v = atom; // swap
-				markUpdate(u, u->x+dir, u->y); // mark chunk-reciever
-				return;
+/*
+ * Pull engine : every cell looks at it's neighbours and decides what it
+ * becomes, stage by stage. Returns count of chunk updates.
+ */
+static int tickPull(void) {
+	int cnt = 0;
+	for (int stage = 0; stage < MAT_STAGES; stage++) {
+		int inncnt;
+		repeat_stage:
+		inncnt = 0;
+		for (int i = 0; i < MAPLEN; i++) {
+			struct chunk* c = World.update.data[i];
+			while (c) {
+				if ((c->wasUpdated & (1 << stage)) != 0 || !chunkActive(c)) { // skip
+					c = c->next2;
+					continue;
+				}
+				
+				uint64_t start = prof_clock();
+				bool updated = updateChunk(c, stage);
+				heatChunk(c, start);
+				if (updated) { // done
+					c->is_changed = 1;
+					c->wasUpdated |= (1 << stage);
+					cnt++;
+					inncnt++;
+				};
+				c = c->next2;	
 			}
 		}
-		break;
-		case 2:
-		if (IS_AIR(u->v)) { // air
-			atom = getpixel(u, u->x+1, u->y);
-	
-			if (IS_SAND(atom) && IS_SAND(getpixel(u, u->x+1, u->y-1))) {
-				u->v = atom; // swap
-				markUpdate(u, u->x+1, u->y); // mark chunk-sender
-				return;
+		if (inncnt != 0) goto repeat_stage;
+		// swap buffers
+		for (int i = 0; i < MAPLEN; i++) {
+			struct chunk* c = World.update.data[i];
+			while (c) {
+				if ((c->wasUpdated & (1 << stage))) {
+					c->wIndex = !c->wIndex;
+					touchChunk(c);
+				}
+				c = c->next2;
 			}
+		}
 
-			if (IS_WATER(atom) && !IS_AIR(getpixel(u, u->x+1, u->y+1))) {
-				u->v = atom; // swap
-				markUpdate(u, u->x+1, u->y); // mark chunk-sender
-				return;
-			}
-	
-		} else if (IS_SAND(u->v) && IS_SAND(getpixel(u, u->x, u->y-1))) {
-			atom = getpixel(u, u->x-1, u->y); 
-	
-			if (IS_AIR(atom)) {
-				u->v = atom; // swap
-				markUpdate(u, u->x-1, u->y); // mark chunk-reciever
-				return;
+	}
+
+	// remove "was updated" flag and not updated chunks. Sleepers stay
+	int queued = 0, sleeping = 0;
+	for (int i = 0; i < MAPLEN; i++) {
+		struct chunk* c = World.update.data[i];
+		struct chunk* p = NULL;
+		while (c) {
+			if (!c->wasUpdated && !chunkActive(c)) {
+				p = c;
+				c = c->next2;
+				sleeping++;
+				continue;
 			}
-		} else if (IS_WATER(u->v) && !IS_AIR(getpixel(u, u->x, u->y+1))) {
-			atom = getpixel(u, u->x-1, u->y); 
-	
-			if (IS_AIR(atom)) {
-				u->v = atom; // swap
-				markUpdate(u, u->x-1, u->y); // mark chunk-reciever
-				return;
+
+			if (!c->wasUpdated) {
+				if (p) p->next2 = c->next2;
+				else World.update.data[i] = c->next2; 
+				c = c->next2; // p stays the same
+				continue;
 			}
+			c->wasUpdated = 0;
+			p = c; // now we are previous
+			c = c->next2;
+			queued++;
 		}
-		break;
-		case 3:
+	}
+	PROF_GAUGE("update queue", queued);
+	PROF_GAUGE("sleeping chunks", sleeping);
+	PROF_COUNT("chunk updates", cnt);
+	return cnt;
+}
 
-		break;
-		case 4:
+/*
+ * Margolus engine : fall and slide stages fused into ONE in-place pass
+ * over 2x2 blocks. Block grid is shifted by one cell every other tick,
+ * so every cell is in the top row of some block once per two ticks, and
+ * falls one cell per tick, as in pull engine. Blocks are disjoint, so
+ * there are no buffer flips and no rescans.
+ *
+ * Rules of the block [a b / c d], every cell moves at most once :
+ *  - falling things sink into the lighter cell under it (a -> c, b -> d)
+ *  - bottom pile (sand) with pile above it slides into the air beside
+ *    it, if there is something to land on
+ *  - flowing (water) with something under it moves in it's direction
+ *  - no reactions here (yet)
+ *
+ * Tolerance, compared with pull : per material cell counts are the same
+ * (only swaps here), sideways moves are at most one cell per tick (pull
+ * does up to two) and water never goes against it's direction, so
+ * shapes differ in details. tests/determinism.c checks mass and mean
+ * height of every material against pull, see --compare.
+ *
+ * Block is owned by the chunk of it's top left cell. Blocks crossing
+ * chunk borders go through the slow path, and are skipped if any of their
+ * chunks is not resident (or sleeps, see LOD). Chunk stays queued until
+ * it was idle for two ticks (both block offsets).
+ */
 
-		break;
-		case 5:
+#define M_DONE  1 // processed in this tick
+#define M_MOVED 2 // something has moved in it in this tick
+#define M_IDLE  4 // was idle in the previous tick
 
-		break;
-		case 6:
+// q : a, b, c, d. under : cells below c and d. Returns mask of changed cells
+static int blockRules(uint8_t q[4], uint8_t under_c, uint8_t under_d) {
+	int moved = 0; // cells that got their final value
 
-		break;
-		case 7:
+	// fall
+	for (int i = 0; i < 2; i++) {
+		if (matSinks(q[i], q[i + 2])) {
+			uint8_t t = q[i]; q[i] = q[i + 2]; q[i + 2] = t;
+			moved |= 1 << i | 1 << (i + 2);
+		}
+	}
+
+	// sand under pressure slides (c -> d or d -> c), onto support only
+	if (!(moved & 12)) {
+		if (IS_PILE(q[2]) && IS_PILE(q[0]) && IS_AIR(q[3]) && !IS_AIR(under_d)) {
+			q[3] = q[2]; q[2] = 0;
+			moved |= 12;
+		} else if (IS_PILE(q[3]) && IS_PILE(q[1]) && IS_AIR(q[2]) && !IS_AIR(under_c)) {
+			q[2] = q[3]; q[3] = 0;
+			moved |= 12;
+		}
+	}
 
-		break;
-		default: break;
+	// supported water goes in it's direction : 1 - right, 0 - left
+	const uint8_t under[4] = {q[2], q[3], under_c, under_d};
+	for (int row = 0; row < 4; row += 2) {
+		int l = row, r = row + 1;
+		if (moved & (1 << l | 1 << r)) continue;
+		if (IS_FLOW(q[l]) && (q[l] & 1) && IS_AIR(q[r]) && !IS_AIR(under[l])) {
+			q[r] = q[l]; q[l] = 0;
+			moved |= 1 << l | 1 << r;
+		} else if (IS_FLOW(q[r]) && !(q[r] & 1) && IS_AIR(q[l]) && !IS_AIR(under[r])) {
+			q[l] = q[r]; q[r] = 0;
+			moved |= 1 << l | 1 << r;
+		}
 	}
+	return moved;
 }
 
-#include <string.h>
-#include <raylib.h>
+static void movedChunk(struct chunk* c) {
+	c->is_changed = 1;
+	c->wasUpdated |= M_MOVED;
+	touchChunk(c);
+}
 
+// block on the chunk border. Returns true if something has moved
+static bool borderBlock(int64_t x, int64_t y) {
+	struct chunk* ch[4];
+	uint8_t* p[4];
+	uint8_t q[4], old[4];
+	for (int i = 0; i < 4; i++) {
+		int64_t px = x + (i & 1), py = y + (i >> 1);
+		ch[i] = findChunk(&World.map, (uint64_t)px/CHUNK_WIDTH, (uint64_t)py/CHUNK_WIDTH);
+		if (!ch[i] || !chunkActive(ch[i])) return false; // wall
+		p[i] = getChunkData(ch[i], MODE_READ) +
+			(uint64_t)px%CHUNK_WIDTH + (uint64_t)py%CHUNK_WIDTH * CHUNK_WIDTH;
+		q[i] = old[i] = *p[i];
+	}
 
-bool updateChunk(struct chunk* c, const int stage) {
-	struct updater u = {c, 0, 0, 0}; // SHOULD be optimized out...
-	uint8_t* read = getChunkData(u.c, MODE_READ);
-	uint8_t* writ = getChunkData(u.c, MODE_WRITE);
-	bool need  = false;
-
-	for (u.y = 0; u.y < CHUNK_WIDTH; u.y++) {
-		for (u.x = 0; u.x < CHUNK_WIDTH; u.x++) {
-			u.v = read[u.x + u.y * CHUNK_WIDTH];
-			processor(&u, stage);
-			if (u.v != read[u.x + u.y * CHUNK_WIDTH])
-				need = true;
-			writ[u.x + u.y * CHUNK_WIDTH] = u.v;
-		}
+	int moved = blockRules(q, _getpixel(x, y + 2), _getpixel(x + 1, y + 2));
+	if (!moved) return false;
+	for (int i = 0; i < 4; i++) {
+		if (q[i] == old[i]) continue;
+		*p[i] = q[i];
+		markWorldUpdate(x + (i & 1), y + (i >> 1)); // may be not queued yet
+		movedChunk(ch[i]);
+		ch[i]->changes++;
 	}
-	return need;
+	return true;
 }
 
-#include <string.h>
+static bool margolusChunk(struct chunk* c, int off) {
+	uint8_t* data = getChunkData(c, MODE_READ);
+	const int64_t gx = (int64_t)c->pos.axis[0] * CHUNK_WIDTH;
+	const int64_t gy = (int64_t)c->pos.axis[1] * CHUNK_WIDTH;
+	bool any = false;
+	int changed = 0;
 
-#define TPS 64
-#define MIN_TICK (1.0/(double)TPS)
-#define MAX_STAGES 3
-static double old_time = 0.0;
+	for (int by = off; by < CHUNK_WIDTH; by += 2) {
+		for (int bx = off; bx < CHUNK_WIDTH; bx += 2) {
+			if (bx == CHUNK_WIDTH - 1 || by == CHUNK_WIDTH - 1) {
+				any |= borderBlock(gx + bx, gy + by);
+				continue;
+			}
 
-void updateWorld(void) {
-	double dt = GetTime() - old_time;
-	if (dt < MIN_TICK) { // too early
+			uint8_t* a = data + bx + by * CHUNK_WIDTH;
+			uint8_t q[4] = {a[0], a[1], a[CHUNK_WIDTH], a[CHUNK_WIDTH + 1]};
+			if (!(q[0] | q[1] | q[2] | q[3])) continue; // all air, common
+
+			uint8_t uc, ud;
+			if (by + 2 < CHUNK_WIDTH) {
+				uc = a[CHUNK_WIDTH*2];
+				ud = a[CHUNK_WIDTH*2 + 1];
+			} else {
+				uc = _getpixel(gx + bx, gy + by + 2);
+				ud = _getpixel(gx + bx + 1, gy + by + 2);
+			}
+
+			int moved = blockRules(q, uc, ud);
+			if (!moved) continue;
+			a[0] = q[0]; a[1] = q[1];
+			a[CHUNK_WIDTH] = q[2]; a[CHUNK_WIDTH + 1] = q[3];
+			changed += __builtin_popcount(moved);
+			any = true;
+		}
+	}
+
+	c->changes += changed;
+	if (any) {
+		movedChunk(c);
+		// they own blocks on our top and left borders
+		markWorldUpdate(gx - 1, gy);
+		markWorldUpdate(gx, gy - 1);
+		markWorldUpdate(gx - 1, gy - 1);
+	}
+	return any;
+}
+
+static int tickMargolus(void) {
+	const int off = (World.tick + lod_substep) & 1;
+	int cnt = 0, inncnt;
+
+	do { // chunks woken up in this tick are processed too
+		inncnt = 0;
 		for (int i = 0; i < MAPLEN; i++) {
-			struct chunk* c = World.update.data[i];
-			while (c) {
-				c->usagefactor = CHUNK_USAGE_VALUE;
-				c = c->next2;
+			for (struct chunk* c = World.update.data[i]; c; c = c->next2) {
+				if ((c->wasUpdated & M_DONE) || !chunkActive(c)) continue;
+				c->wasUpdated |= M_DONE;
+				inncnt++;
+				uint64_t start = prof_clock();
+				if (margolusChunk(c, off)) cnt++;
+				heatChunk(c, start);
 			}
 		}
-		return;
-	};
-	int repeat = dt/MIN_TICK;
-	assert(repeat);
-	old_time = GetTime();
+	} while (inncnt);
+
+	// drop chunks that were idle for two ticks. Sleepers stay
+	int queued = 0, sleeping = 0;
+	for (int i = 0; i < MAPLEN; i++) {
+		struct chunk* c = World.update.data[i];
+		struct chunk* p = NULL;
+		while (c) {
+			int w = c->wasUpdated;
+			if (!(w & M_DONE)) {
+				sleeping++;
+			} else if (w & M_MOVED) {
+				c->wasUpdated = 0;
+			} else if (!(w & M_IDLE)) {
+				c->wasUpdated = M_IDLE;
+			} else {
+				c->wasUpdated = 0;
+				if (p) p->next2 = c->next2;
+				else World.update.data[i] = c->next2;
+				c = c->next2; // p stays the same
+				continue;
+			}
+			p = c;
+			c = c->next2;
+			queued++;
+		}
+	}
+	PROF_GAUGE("update queue", queued);
+	PROF_GAUGE("sleeping chunks", sleeping);
+	PROF_COUNT("chunk updates", cnt);
+	return cnt;
+}
+
+// simulation engines, selected by World.engine
+static int (*const engines[])(void) = {
+	tickPull,
+	tickMargolus
+};
+
+const char* world_engines[] = {
+	"pull",
+	"margolus"
+};
+
+const int world_engines_count = sizeof(engines)/sizeof(*engines);
+
+static void keepQueueAlive(void) {
+	for (int i = 0; i < MAPLEN; i++) {
+		struct chunk* c = World.update.data[i];
+		while (c) {
+			c->usagefactor = CHUNK_USAGE_VALUE;
+			c = c->next2;
+		}
+	}
+}
+
+/*
+ * One tick with the LOD rings. Far ring joins the near one every rate
+ * ticks (so they are connected sometimes), and then catches up alone.
+ */
+static int stepWorld(int (*engine)(void)) {
+	if (!World.lod.enabled) {
+		lod_mask = ~0;
+		return engine();
+	}
+
+	const int rate = World.lod.rate > 1 ? World.lod.rate : 1;
+	bool far = World.tick % rate == 0;
+	lod_mask = far ? 3 : 1;
+	int cnt = engine();
+	if (far) {
+		int steps = rate < LOD_CATCHUP_MAX ? rate : LOD_CATCHUP_MAX;
+		lod_mask = 2;
+		for (lod_substep = 1; lod_substep < steps; lod_substep++) cnt += engine();
+		lod_substep = 0;
+	}
+	lod_mask = 1;
+	return cnt;
+}
+
+static int tickWorld(int (*engine)(void)) {
+	if (World.tick % WORLD_TPS == 0) coolChunks();
+	int cnt = stepWorld(engine);
+	if (World.water_solver) {
+		PROF_BEGIN_ZONE("water solver");
+		cnt += tickWater();
+		prof_end();
+	}
+	return cnt;
+}
+
+void updateWorld(void) {
+	assert(world_clock && "setWorldClock() was not called!");
+	double now = world_clock();
+	double start = now;
+	Sched.accum += now - old_time;
+	old_time = now;
+	Sched.stat.ticks = 0;
 
 	if (!World.is_update_enabled) { // yeah
 		// cleanup map
 		for (int i = 0; i < MAPLEN; i++) {
 			World.update.data[i] = NULL; // hehehe
 		}
+		Sched.accum = 0.0;
+		Sched.stat.lag = Sched.stat.alpha = 0.0;
 		return;
 	}
 
-	for (; repeat > 0; repeat--) {
-		int cnt = 0;
-		for (int stage = 0; stage < MAX_STAGES; stage++) {
-			int inncnt;
-			repeat_stage:
-			inncnt = 0;
-			for (int i = 0; i < MAPLEN; i++) {
-				struct chunk* c = World.update.data[i];
-				while (c) {
-					if ((c->wasUpdated & (1 << stage)) != 0) { // skip
-						c = c->next2;
-						continue;
-					}
-					
-					if (updateChunk(c, stage)) { // done
-						c->is_changed = 1;
-						c->wasUpdated |= (1 << stage);
-						cnt++;
-						inncnt++;
-					};
-					c = c->next2;	
-				}
-			}
-			if (inncnt != 0) goto repeat_stage;
-			// swap buffers
-			for (int i = 0; i < MAPLEN; i++) {
-				struct chunk* c = World.update.data[i];
-				while (c) {
-					if ((c->wasUpdated & (1 << stage))) {
-						c->wIndex = !c->wIndex;
-					}
-					c = c->next2;
-				}
-			}
+	// spiral of death guard
+	if (Sched.accum > MAX_LAG) {
+		uint64_t drop = (Sched.accum - MAX_LAG) / MIN_TICK;
+		Sched.accum -= drop * MIN_TICK;
+		Sched.stat.dropped += drop;
+		PROF_COUNT("dropped ticks", drop);
+	}
 
-		}
+	if (Sched.accum < MIN_TICK) keepQueueAlive(); // too early
 
-		// remove "was updated" flag and not updated chunks
-		for (int i = 0; i < MAPLEN; i++) {
-			struct chunk* c = World.update.data[i];
-			struct chunk* p = NULL;
-			while (c) {
-	
-				if (!c->wasUpdated) {
-					if (p) p->next2 = c->next2;
-					else World.update.data[i] = c->next2; 
-					c = c->next2; // p stays the same
-					continue;
-				}
-				c->wasUpdated = 0;
-				p = c; // now we are previous
-				c = c->next2;
-			}
+	int engine = World.engine;
+	if (engine < 0 || engine >= world_engines_count) engine = 0;
+	while (Sched.accum >= MIN_TICK) {
+		if (Sched.stat.ticks >= Sched.max_ticks) break;
+		if (Sched.stat.ticks && world_clock() - start > Sched.budget) break;
+		Sched.accum -= MIN_TICK;
+		Sched.stat.ticks++;
+		World.tick++;
+		if (tickWorld(engines[engine]) == 0) { // nothing to do, idle time is not lag
+			while (Sched.accum >= MIN_TICK) Sched.accum -= MIN_TICK;
+			break;
 		}
-		if (cnt == 0) break;
 	}
+
+	Sched.stat.lag = Sched.accum;
+	Sched.stat.alpha = Sched.accum < MIN_TICK ? Sched.accum / MIN_TICK : 1.0;
+	PROF_GAUGE("sim lag (ms)", (int64_t)(Sched.stat.lag * 1000.0));
 }
@@ -30,12 +30,17 @@ union packpos { // two int16_t!
 
 /* */
 struct chunk {
-	struct chunk *next, *next2; // next2 for minimap!
+	struct chunk *next, *next2; // next2 for minor maps (load/save/update)
 	union packpos pos;
 	uint8_t	atoms[CHUNK_WIDTH*CHUNK_WIDTH*2];
 	int8_t	usagefactor; // GC
 	int8_t	wasUpdated; // stage
 	int8_t  is_changed : 1;
+	int8_t  in_minimap : 1; // queued for minimap update
+	int8_t  wake_on_load : 1; // was in the update queue when unloaded
+	uint32_t version; // content version, see touchChunk()
+	uint32_t cost;    // ns spent on updates, halved every second
+	uint32_t changes; // cells changed by updates, halved every second
 	bool		wIndex; 
 };
 
@@ -60,13 +65,23 @@ extern struct worldState {
 	struct chunkmap map; // chunk map
 
 	int mode; // worldgen mode
+	int engine; // simulation engine, see world_engines[]
 	uint64_t seed; // seed
 	uint64_t playtime;
+	uint64_t tick; // simulation ticks done, keys chunk RNG streams
+	uint32_t version; // global content version clock
+
+	struct { // simulation LOD, see setWorldView()
+		int32_t x0, y0, x1, y1; // view, in chunks
+		int near, far, rate;
+		bool enabled;
+	} lod;
 	
 	struct sqlite3* database; 
 
 	// flags
 	bool is_update_enabled;
+	bool water_solver; // see water.h
 } World;
 
 
@@ -94,11 +109,90 @@ int collectGarbage(void); // collect unused chunks
 bool saveloadTick(); // you must call this every tick for chunks to be loaded/saved!!!
 
 int32_t randomNumber(void); // used by main thread ONLY!
+
+/*
+ * Counter-based random numbers (SplitMix64 finalizer).
+ * Value is a pure function of the key and the index, so there is no
+ * shared state at all : any thread may use it, and the same
+ * (seed, tick, chunk position) key always gives the same sequence,
+ * whatever the update order is.
+ */
+#define RNG_GAMMA 0x9E3779B97F4A7C15ull
+
+static inline uint64_t rngMix(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rngKey(uint64_t seed, uint64_t tick, uint32_t pos) {
+	return rngMix(rngMix(rngMix(seed) ^ tick) ^ pos);
+}
+
+static inline uint64_t rngAt(uint64_t key, uint64_t index) {
+	return rngMix(key + (index + 1) * RNG_GAMMA);
+}
+
+struct rng_stream {
+	uint64_t key;
+	uint64_t index;
+};
+
+static inline uint64_t rngNext(struct rng_stream* s) {
+	return rngAt(s->key, s->index++);
+}
+
+// bulk fill, every value is independent, so loops are vectorizable
+void rngFillBytes(uint64_t key, uint64_t start, uint8_t* out, size_t n);
 float  noise2(float x, float y);
 float  noise1( float x );
 void    setWorldSeed(int64_t); // called ONLY during world creation!
 
 void updateWorld(void);
+#define WORLD_TPS 64 // simulation ticks per second
+
+// world time source in seconds (GetTime() in the game). No raylib here!
+void setWorldClock(double (*clock)(void));
+
+// fixed timestep scheduler stats, updated by every updateWorld() call
+struct world_sched {
+	double lag;   // simulation time we are behind the clock, in seconds
+	double alpha; // fraction of the next tick done, for render interpolation
+	int ticks;    // ticks done by the last updateWorld()
+	uint64_t dropped; // ticks thrown away by the spiral of death guard
+};
+
+const struct world_sched* getWorldSched(void);
+
+// at most max_ticks ticks and budget seconds (soft) per updateWorld()
+void setWorldSchedLimits(int max_ticks, double budget);
+
+/*
+ * Simulation LOD rings around the view (in chunks). Chunks not farther
+ * than near from the view tick every step, chunks not farther than far
+ * tick once per rate steps (and catch up a bit), the rest is frozen.
+ * Frozen and waiting chunks stay in the update queue, and look like
+ * solid walls to their active neighbours, so nothing is lost between.
+ * If GC unloads them meanwhile, they are saved with a wake up flag and
+ * queued again when they are loaded back (see saveload.c).
+ * Without a view (headless) everything ticks every step.
+ */
+void setWorldView(int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+void setWorldLod(int near, int far, int rate);
+void clearWorldView(void);
+
+// 0 - every step, 1 - once per rate steps, 2 - frozen
+static inline int chunkLodRing(int16_t x, int16_t y) {
+	if (!World.lod.enabled) return 0;
+	int32_t dx = x < World.lod.x0 ? World.lod.x0 - x :
+		x > World.lod.x1 ? x - World.lod.x1 : 0;
+	int32_t dy = y < World.lod.y0 ? World.lod.y0 - y :
+		y > World.lod.y1 ? y - World.lod.y1 : 0;
+	int32_t d = dx > dy ? dx : dy;
+	if (d <= World.lod.near) return 0;
+	if (d <= World.lod.far) return 1;
+	return 2;
+}
 
 struct chunk* getWorldChunk(int16_t x, int16_t y); // may fail to load/gen
 uint64_t getMemoryUsage(); // not accurate
@@ -123,3 +217,6 @@ bool getWorldInfo(const char* path, uint64_t *time, int *mode);
 
 extern const char* world_modes[];
 extern const int world_modes_count;
+
+extern const char* world_engines[];
+extern const int world_engines_count;
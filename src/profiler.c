@@ -18,8 +18,12 @@
 
 #include "profiler.h"
 #include "libs/c89threads.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
-const char* prof_entries_names[] = {
+const char* prof_entries_names[PROF_ENTRIES_MAX] = {
 	"game_tick",
 	"inif/free",
 	"draw",
@@ -31,111 +35,312 @@ const char* prof_entries_names[] = {
 	"saveload",
 	"worldgen",
 	"disk IO",
-	"error"
+	"other"
 };
 
+// builtin entries are registered at compile time :p
+static _Atomic int prof_zones_cnt = PROF_ENTRIES_COUNT;
+
+static const char* prof_counters_names[PROF_COUNTERS_MAX];
+static int prof_counters_kind[PROF_COUNTERS_MAX];
+static _Atomic int prof_counters_cnt = 0;
+
 static c89mtx_t prof_threads_mutex;
 
-double prof_clock() {
-	return GetTime();
+/*
+ * Clock source.
+ *
+ * By default it's clock_gettime(CLOCK_MONOTONIC), it's fast enough (vDSO)
+ * and does not need a window, unlike GetTime(). With PROF_USE_TSC defined
+ * we read TSC directly, and convert ticks to nanoseconds with the
+ * multiplier, calibrated against the monotonic clock at first call.
+ * Only use TSC if it's invariant on your CPU!
+ * On windows it's QueryPerformanceCounter(), no window is needed too.
+ */
+#if defined(_WIN32)
+
+// windows.h does not get along with raylib.h, so we declare these two
+__declspec(dllimport) int __stdcall QueryPerformanceCounter(long long* count);
+__declspec(dllimport) int __stdcall QueryPerformanceFrequency(long long* freq);
+
+static _Atomic long long qpc_freq = 0; // ticks per second, fixed at boot
+
+uint64_t prof_clock() { // no clock_gettime() here, sadly
+	long long freq = atomic_load(&qpc_freq), t;
+	if (!freq) {
+		QueryPerformanceFrequency(&freq);
+		atomic_store(&qpc_freq, freq);
+	}
+	QueryPerformanceCounter(&t);
+	// seconds and the rest apart, or it overflows after a few days
+	return (uint64_t)(t / freq) * 1000000000ull +
+		(uint64_t)(t % freq) * 1000000000ull / freq;
+}
+
+#else
+#include <time.h>
+
+static uint64_t mono_clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#if defined(PROF_USE_TSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+
+static uint64_t tsc_base, ns_base;
+static uint64_t tsc_mult; // ns per tick, 32.32 fixed point
+
+static void calibrate() {
+	uint64_t t0 = __rdtsc(), n0 = mono_clock();
+	uint64_t n1 = n0;
+	while (n1 - n0 < 10000000) n1 = mono_clock(); // 10 ms
+	uint64_t t1 = __rdtsc();
+
+	tsc_mult = ((n1 - n0) << 32) / (t1 - t0);
+	tsc_base = t1;
+	ns_base  = n1;
+}
+
+uint64_t prof_clock() {
+	if (!tsc_mult) calibrate(); // same race as in init(), see below
+	uint64_t d = __rdtsc() - tsc_base;
+	// split multiply, (d * tsc_mult) >> 32 overflows in seconds
+	uint64_t hi = (d >> 32) * tsc_mult;
+	uint64_t lo = ((d & 0xFFFFFFFFull) * tsc_mult) >> 32;
+	return ns_base + hi + lo;
 }
 
+#else
+
+uint64_t prof_clock() {
+	return mono_clock();
+}
+
+#endif
+#endif
+
 struct prof_item {
-	double time;
+	uint64_t time;
 	int   entry;
 };
 
+// begin/end event for the trace
+struct prof_event {
+	uint64_t time;
+	int16_t  entry;
+	int16_t  end;
+};
+
+#define PROF_TRACE_LEN (1 << 16) // per thread, must be pow of 2!
+
+static _Atomic bool prof_trace_on = false;
+
+/*
+ * Every thread has it's own context, found through the thread local
+ * pointer (no more scans and id compares on every begin/end).
+ *
+ * Contexts are never freed while program is running : unregistered
+ * ones are just marked dead and reused by the next registered thread.
+ * Thanks to that, reader (drawProfiler) may walk the list and read
+ * the history at any moment without locks.
+ *
+ * History is a per-thread ring. Writer fills the slot first, and only
+ * then publishes new position with release store, so reader, that
+ * loads position with acquire, never sees half-written slots older
+ * than it.
+ */
 struct prof_thread {
 	struct prof_item stack[255];
-	struct prof_stats data[PROF_ENTRIES_COUNT];
-	c89thrd_t id;
+	struct prof_stats data[PROF_ENTRIES_MAX];
+	struct prof_stats history[PROF_ENTRIES_MAX][PROF_HISTORY_LEN];
+	int64_t counters[PROF_COUNTERS_MAX];
+	int64_t counters_history[PROF_COUNTERS_MAX][PROF_HISTORY_LEN];
+	uint16_t histogram[PROF_ENTRIES_MAX][PROF_BUCKETS]; // of history
+	uint64_t frame_start; // when top level zone was started
+	uint64_t frame_time;  // sum of top level zones in this step
+	uint32_t frames;
+	_Atomic int history_pos;
+	_Atomic bool alive;
+	_Atomic(struct prof_thread*) next;
+	struct prof_event* trace; // allocated when tracing is enabled
+	_Atomic uint32_t trace_pos; // total amount of recorded events
 	int stackpos;
-	c89mtx_t mutex;
-} prof_threads[PROF_THREADS_MAX] = {0};
+	int index;
+};
 
-// summary history
-static struct prof_stats prof_history[PROF_THREADS_MAX] [PROF_ENTRIES_COUNT][PROF_HISTORY_LEN];
-static int prof_history_pos = 0;
+static _Atomic(struct prof_thread*) prof_threads = NULL;
+static _Atomic int prof_threads_cnt = 0;
+static _Thread_local struct prof_thread* prof_ctx = NULL;
 
 #include <assert.h>
 #include <stdlib.h>
 
 static void onfree() {
 	c89mtx_destroy(&prof_threads_mutex);
-	for (int i = 0; i < PROF_THREADS_MAX; i++) {
-		c89mtx_lock(&prof_threads[i].mutex);
-		c89mtx_unlock(&prof_threads[i].mutex);
-		c89mtx_destroy(&prof_threads[i].mutex);
-	}
+	// contexts are leaked : other threads may still be alive at exit
 }
 
 static int prof_initialized = 0;
+static void dumpatexit();
 
 // RACE CONDITION : First call of the profiler MUST happen
 // in main thread only. Afterwards, it's safe to use :p
 static void init() {
 	if (prof_initialized) return;
 	c89mtx_init(&prof_threads_mutex, 0);
-	for (int i = 0; i < PROF_THREADS_MAX; i++) {
-		c89mtx_init(&prof_threads[i].mutex, 0);
-		prof_threads[i].stackpos = -1;
-	}
 	atexit(onfree);
+	if (getenv("PIXELBOX_TRACE")) {
+		prof_trace_enable(true);
+		atexit(dumpatexit);
+	}
 	prof_initialized = 1;
 }
 
+static void resetctx(struct prof_thread* x) {
+	memset(x->data, 0, sizeof(x->data));
+	atomic_store(&x->trace_pos, 0);
+	memset(x->history, 0, sizeof(x->history));
+	memset(x->counters, 0, sizeof(x->counters));
+	memset(x->counters_history, 0, sizeof(x->counters_history));
+	memset(x->histogram, 0, sizeof(x->histogram));
+	x->frame_time = 0;
+	x->frames = 0;
+	atomic_store(&x->history_pos, 0);
+	x->stackpos = -1;
+}
+
 void prof_register_thread() {
 	init();
+	assert(!prof_ctx && "Thread is already registered!");
 
-	c89thrd_t id = c89thrd_current();
 	// LOCKABLE
 	c89mtx_lock(&prof_threads_mutex);
-	for (int i = 0; i < PROF_THREADS_MAX; i++) {
-		if (prof_threads[i].id == 0) {
-			prof_threads[i].id = id;
+
+	// reuse dead context first
+	struct prof_thread *x = atomic_load(&prof_threads), *last = NULL;
+	for (; x; last = x, x = atomic_load(&x->next)) {
+		if (!atomic_load(&x->alive)) break;
+	}
+
+	if (!x) {
+		x = calloc(1, sizeof(struct prof_thread));
+		if (!x) {
 			c89mtx_unlock(&prof_threads_mutex);
-			return;
+			perror("NOMEM!");
+			abort();
 		}
+		x->index = atomic_load(&prof_threads_cnt);
+		// fully initialized before it becomes visible to readers
+		resetctx(x);
+		if (last) atomic_store(&last->next, x);
+		else atomic_store(&prof_threads, x);
+		atomic_fetch_add(&prof_threads_cnt, 1);
+	} else {
+		resetctx(x);
 	}
+
+	atomic_store(&x->alive, true);
 	c89mtx_unlock(&prof_threads_mutex);
-	assert(0 && "Too many threads are already registered in profiler!");
+	prof_ctx = x;
 }
 
 void prof_unregister_thread() {
-	c89thrd_t id = c89thrd_current();
-
-	// non atomic read/write...
-	// but it should not cause problems...
-	for (int i = 0; i < PROF_THREADS_MAX; i++) {
-		if (prof_threads[i].id == id) {
-			prof_threads[i].id = 0;
-			return;
+	assert(prof_ctx && "Thread is not registered!");
+	atomic_store(&prof_ctx->alive, false);
+	prof_ctx = NULL;
+}
+
+static inline struct prof_thread* getctx() {
+	assert(prof_ctx && "This thread was not registered!");
+	return prof_ctx;
+}
+
+static struct prof_thread* getthread(int thread) {
+	struct prof_thread* x = atomic_load(&prof_threads);
+	while (x && x->index != thread) x = atomic_load(&x->next);
+	return x;
+}
+
+int prof_threads_count() {
+	return atomic_load(&prof_threads_cnt);
+}
+
+/*
+ * Runtime registration of zones and counters.
+ * Names are compared with strcmp(), so it's slow. Cache the handle!
+ * (PROF_BEGIN_ZONE() and friends do that for you)
+ */
+int prof_zone(const char* name) {
+	int n = atomic_load(&prof_zones_cnt);
+	for (int i = 0; i < n; i++)
+		if (strcmp(prof_entries_names[i], name) == 0) return i;
+
+	c89mtx_lock(&prof_threads_mutex);
+	n = atomic_load(&prof_zones_cnt);
+	int i = 0;
+	while (i < n && strcmp(prof_entries_names[i], name) != 0) i++;
+	if (i == n) {
+		if (n >= PROF_ENTRIES_MAX) i = PROF_OTHER; // too many, sorry
+		else { // name first, count after
+			prof_entries_names[n] = name;
+			atomic_store(&prof_zones_cnt, n + 1);
 		}
 	}
-	assert(0 && "Thread is not registered!");
+	c89mtx_unlock(&prof_threads_mutex);
+	return i;
+}
+
+int prof_zones_count() {
+	return atomic_load(&prof_zones_cnt);
 }
 
-static struct prof_thread* getctx() {
-	c89thrd_t id = c89thrd_current();
+int prof_counter(const char* name, int kind) {
+	int n = atomic_load(&prof_counters_cnt);
+	for (int i = 0; i < n; i++)
+		if (strcmp(prof_counters_names[i], name) == 0) return i;
 
-	// NON-ATOMIC READ! Should not make problems, surely :clueless:
-	// without this assumption, we will loss A LOT in perfomance
-	for (int i = 0; i < PROF_THREADS_MAX; i++) {
-		if (c89thrd_equal(prof_threads[i].id, id)) {
-			return prof_threads + i;
+	c89mtx_lock(&prof_threads_mutex);
+	n = atomic_load(&prof_counters_cnt);
+	int i = 0;
+	while (i < n && strcmp(prof_counters_names[i], name) != 0) i++;
+	if (i == n) {
+		if (n >= PROF_COUNTERS_MAX) i = -1; // ignored
+		else {
+			prof_counters_names[n] = name;
+			prof_counters_kind[n]  = kind;
+			atomic_store(&prof_counters_cnt, n + 1);
 		}
 	}
+	c89mtx_unlock(&prof_threads_mutex);
+	return i;
+}
+
+int prof_counters_count() {
+	return atomic_load(&prof_counters_cnt);
+}
+
+const char* prof_counter_name(int counter) {
+	assert(counter >= 0 && counter < prof_counters_count());
+	return prof_counters_names[counter];
+}
+
+void prof_count(int counter, int64_t v) {
+	if (counter < 0) return;
+	getctx()->counters[counter] += v;
+}
 
-	assert(0 && "This thread was not registered!");
+void prof_gauge(int counter, int64_t v) {
+	if (counter < 0) return;
+	getctx()->counters[counter] = v;
 }
 
 typedef struct prof_thread* ctx_t;
 
 #define GETCTX() ctx_t x = getctx();
-#define LOCK()   //c89mtx_lock(&x->mutex)
-#define UNLOCK() //c89mtx_unlock(&x->mutex)
 
-static inline void push(ctx_t x, int i, double time) {
+static inline void push(ctx_t x, int i, uint64_t time) {
 	x->stackpos++;
 	assert(x->stackpos < 255 && "profiler stack overflow");
 	x->stack[x->stackpos].time = time; 
@@ -159,8 +364,6 @@ static inline bool have(ctx_t x) {
 	return x->stackpos >= 0;
 }
 
-#include <string.h>
-
 /* How does it work?
  * Every time we push new profiler scope(entry), we set
  * summary and own time for previous as difference of 
@@ -182,11 +385,24 @@ static inline bool have(ctx_t x) {
  * may work very ugly, but it works, and i don't need more :p
  */
 
+// appends event to the trace ring, if tracing is enabled
+static inline void record(ctx_t x, int entry, int end, uint64_t time) {
+	if (!atomic_load_explicit(&prof_trace_on, memory_order_relaxed)) return;
+	if (!x->trace) {
+		x->trace = malloc(sizeof(struct prof_event) * PROF_TRACE_LEN);
+		if (!x->trace) return;
+	}
+	uint32_t pos = atomic_load_explicit(&x->trace_pos, memory_order_relaxed);
+	x->trace[pos & (PROF_TRACE_LEN-1)] = (struct prof_event){time, entry, end};
+	atomic_store_explicit(&x->trace_pos, pos + 1, memory_order_release);
+}
+
 void prof_begin(int entry) {
-	assert(entry >= 0 && entry < PROF_ENTRIES_COUNT);
+	assert(entry >= 0 && entry < prof_zones_count());
 	GETCTX();
-	LOCK();
-	double time = prof_clock();
+	uint64_t time = prof_clock();
+
+	if (!have(x)) x->frame_start = time;
 
 	// set owntime and sumtime for previous entry
 	if (have(x)) {
@@ -200,15 +416,14 @@ void prof_begin(int entry) {
 
 	push(x, entry, time);
 	x->data[entry].ncalls++;
-	UNLOCK();
+	record(x, entry, 0, time);
 }
 
 void prof_end() {
 	GETCTX();
-	LOCK();
 	struct prof_item item = pop(x);
 	struct prof_stats* stat = x->data + item.entry;
-	double time = prof_clock();
+	uint64_t time = prof_clock();
 
 	stat->owntime += time - item.time;
 	stat->sumtime += time - item.time;
@@ -219,34 +434,221 @@ void prof_end() {
 
 		stat->sumtime += time - prev->time;
 		prev->time     = time;
-	}
-	UNLOCK();
+	} else x->frame_time += time - x->frame_start;
+	record(x, item.entry, 1, time);
 }
 
+/*
+ * Log scale buckets : 4 sub-buckets per octave, so error is < 25%.
+ * Values below 4 ns have their own buckets.
+ */
+static inline int bucket(uint64_t v) {
+	if (v < 4) return v;
+	int e = 63 - __builtin_clzll(v);
+	return 4*(e - 1) + ((v >> (e - 2)) & 3);
+}
+
+static inline uint64_t bucketValue(int b) {
+	if (b < 4) return b;
+	return (uint64_t)(4 + (b & 3)) << (b/4 - 1);
+}
+
+static void checkHitch(ctx_t x);
+
 void prof_step() {
 	GETCTX();
-	LOCK();
-	
-	int thread = x - prof_threads;
-
-	for (int i = 0; i < PROF_ENTRIES_COUNT; i++) {
-		prof_history[thread][i][prof_history_pos] = x->data[i];
-		x->data[i] = (struct prof_stats){0};
-	}	
-	UNLOCK();
-	prof_history_pos++;
-	if (prof_history_pos >= PROF_HISTORY_LEN) {
-		prof_history_pos = 0;
+	int pos = atomic_load_explicit(&x->history_pos, memory_order_relaxed);
+
+	for (int i = 0; i < prof_zones_count(); i++) {
+		// rolling histogram : forget the sample we overwrite
+		struct prof_stats* old = &x->history[i][pos];
+		if (old->ncalls) x->histogram[i][bucket(old->sumtime)]--;
+		if (x->data[i].ncalls) x->histogram[i][bucket(x->data[i].sumtime)]++;
+
+		x->history[i][pos] = x->data[i];
 	}
+
+	x->frames++;
+	checkHitch(x);
+	x->frame_time = 0;
+	memset(x->data, 0, sizeof(x->data));
+
+	for (int i = 0; i < prof_counters_count(); i++) {
+		x->counters_history[i][pos] = x->counters[i];
+		if (prof_counters_kind[i] == PROF_KIND_COUNT) x->counters[i] = 0;
+	}
+
+	// publish written slot
+	pos = (pos + 1) % PROF_HISTORY_LEN;
+	atomic_store_explicit(&x->history_pos, pos, memory_order_release);
 } 
 
 /*
  * the only way to get data back, but it's good enough :P
+ * Returns NULL if there is no such thread.
  */
 struct prof_stats* prof_summary(int entry, int thread) {
-	assert(entry >= 0 && entry < PROF_ENTRIES_COUNT);
-	assert(thread >= 0 && thread < PROF_THREADS_MAX);
-	return prof_history[thread][entry];
+	assert(entry >= 0 && entry < PROF_ENTRIES_MAX);
+	struct prof_thread* x = getthread(thread);
+	return x ? x->history[entry] : NULL;
+}
+
+uint64_t prof_percentile(int entry, int thread, float p) {
+	assert(entry >= 0 && entry < PROF_ENTRIES_MAX);
+	struct prof_thread* x = getthread(thread);
+	if (!x) return 0;
+
+	const uint16_t* h = x->histogram[entry];
+	int total = 0;
+	for (int i = 0; i < PROF_BUCKETS; i++) total += h[i];
+	if (!total) return 0;
+
+	int need = total * p, sum = 0;
+	for (int i = 0; i < PROF_BUCKETS; i++) {
+		sum += h[i];
+		if (sum > need) return bucketValue(i);
+	}
+	return bucketValue(PROF_BUCKETS - 1);
+}
+
+/*
+ * Hitch detector.
+ * Steps, which top level zones took longer than the threshold, are copied
+ * with all their zones into the worst frames list. Only PROF_HITCHES_MAX
+ * worst ones are kept.
+ */
+static struct prof_hitch prof_hitches[PROF_HITCHES_MAX];
+static int prof_hitches_cnt = 0;
+static _Atomic uint64_t prof_hitch_ns = 33000000; // 33 ms
+
+void prof_hitch_threshold(uint64_t ns) {
+	atomic_store(&prof_hitch_ns, ns);
+}
+
+static void checkHitch(ctx_t x) {
+	if (x->frame_time < atomic_load_explicit(&prof_hitch_ns, memory_order_relaxed))
+		return;
+
+	c89mtx_lock(&prof_threads_mutex);
+	int slot = prof_hitches_cnt;
+	if (slot >= PROF_HITCHES_MAX) { // replace the best of the worst
+		slot = 0;
+		for (int i = 1; i < PROF_HITCHES_MAX; i++)
+			if (prof_hitches[i].time < prof_hitches[slot].time) slot = i;
+		if (prof_hitches[slot].time >= x->frame_time) slot = -1;
+	} else prof_hitches_cnt++;
+
+	if (slot >= 0) {
+		struct prof_hitch* h = prof_hitches + slot;
+		h->time   = x->frame_time;
+		h->frame  = x->frames;
+		h->thread = x->index;
+		memcpy(h->data, x->data, sizeof(h->data));
+	}
+	c89mtx_unlock(&prof_threads_mutex);
+}
+
+int prof_hitches_get(struct prof_hitch* out, int max) {
+	if (!prof_initialized) return 0;
+	c89mtx_lock(&prof_threads_mutex);
+	int n = prof_hitches_cnt < max ? prof_hitches_cnt : max;
+	memcpy(out, prof_hitches, n * sizeof(struct prof_hitch));
+	c89mtx_unlock(&prof_threads_mutex);
+
+	// worst first
+	for (int i = 1; i < n; i++) {
+		struct prof_hitch t = out[i];
+		int j = i;
+		for (; j > 0 && out[j-1].time < t.time; j--) out[j] = out[j-1];
+		out[j] = t;
+	}
+	return n;
+}
+
+void prof_hitches_clear() {
+	if (!prof_initialized) return;
+	c89mtx_lock(&prof_threads_mutex);
+	prof_hitches_cnt = 0;
+	c89mtx_unlock(&prof_threads_mutex);
+}
+
+int64_t* prof_counter_history(int counter, int thread) {
+	assert(counter >= 0 && counter < PROF_COUNTERS_MAX);
+	struct prof_thread* x = getthread(thread);
+	return x ? x->counters_history[counter] : NULL;
+}
+
+int prof_summary_pos(int thread) {
+	struct prof_thread* x = getthread(thread);
+	if (!x) return 0;
+	return atomic_load_explicit(&x->history_pos, memory_order_acquire);
+}
+
+/*
+ * Trace recording.
+ * Every thread writes begin/end events into it's own ring, oldest events
+ * are overwritten. Dump is done without stopping anyone, so events that
+ * are written at the same moment may be lost. Don't care :p
+ */
+void prof_trace_enable(bool enable) {
+	atomic_store(&prof_trace_on, enable);
+}
+
+bool prof_trace_enabled() {
+	return atomic_load(&prof_trace_on);
+}
+
+static void dumpthread(FILE* f, struct prof_thread* x, bool* first) {
+	const char* name = x->index ? "worker" : "main";
+	fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"tid\":%i,\"args\":{\"name\":\"%s %i\"}}",
+		*first ? "" : ",", x->index, name, x->index);
+	*first = false;
+	if (!x->trace) return;
+
+	uint32_t end = atomic_load_explicit(&x->trace_pos, memory_order_acquire);
+	uint32_t pos = end > PROF_TRACE_LEN ? end - PROF_TRACE_LEN : 0;
+	int depth = 0;
+
+	for (; pos != end; pos++) {
+		struct prof_event e = x->trace[pos & (PROF_TRACE_LEN-1)];
+		if (e.end) {
+			if (depth <= 0) continue; // begin was overwritten
+			depth--;
+		} else depth++;
+
+		fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,"
+			"\"tid\":%i,\"ts\":%llu.%03llu}",
+			prof_entries_names[e.entry], e.end ? 'E' : 'B', x->index,
+			(unsigned long long)(e.time / 1000),
+			(unsigned long long)(e.time % 1000));
+	}
+}
+
+bool prof_trace_dump(const char* path) {
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		perror("can't open trace file");
+		return false;
+	}
+
+	bool first = true;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	struct prof_thread* x = atomic_load(&prof_threads);
+	for (; x; x = atomic_load(&x->next)) dumpthread(f, x, &first);
+	fprintf(f, "\n]}\n");
+
+	if (fclose(f)) {
+		perror("can't write trace file");
+		return false;
+	}
+	return true;
+}
+
+static void dumpatexit() {
+	const char* path = getenv("PIXELBOX_TRACE");
+	if (!path || !*path) return;
+	if (prof_trace_dump(path)) printf("trace is written to %s\n", path);
 }
 
 #include "raygui.h"
@@ -272,8 +674,19 @@ void drawProfiler(Rectangle rec) {
 		100, 10
 	};
 
-	static int active_thrd = 0;
-	active_thrd = GuiComboBox(item, "main;2;3;4;5", active_thrd); 
+	// "main;1;2;..." for every thread, that was ever registered
+	static char combo[256];
+	static int combo_cnt = 0, active_thrd = 0;
+	int cnt = prof_threads_count();
+	if (cnt != combo_cnt) {
+		int len = snprintf(combo, sizeof(combo), "main");
+		for (int i = 1; i < cnt && len < (int)sizeof(combo) - 8; i++)
+			len += snprintf(combo + len, sizeof(combo) - len, ";%i", i);
+		combo_cnt = cnt;
+	}
+	if (!cnt) return;
+	active_thrd = GuiComboBox(item, combo, active_thrd); 
+	if (active_thrd >= cnt) active_thrd = 0;
 
 	item.y += item.height;
 
@@ -281,7 +694,8 @@ void drawProfiler(Rectangle rec) {
 	item.width  = rec.width - 5; 
 	DrawRectangleRec(item, (Color){0, 0, 0, 255});
 
-	for (int i = 0; i < PROF_ENTRIES_COUNT; i++) {
+	int zones = prof_zones_count();
+	for (int i = 0; i < zones; i++) {
 		Rectangle o = (Rectangle){
 			item.x, item.y + i*8,
 			6, 6
@@ -296,26 +710,103 @@ void drawProfiler(Rectangle rec) {
 	item.x      = rec.x + 70; 
 	item.height = (rec.y + rec.height) - item.y - 10;
 
-	float max_value = 1.0/75.0;
-	/*for (int i = 0; i < PROF_HISTORY_LEN; i++) {
-		float v = prof_summary(PROF_GAMETICK)[i].sumtime;
+	// scale by p99, so single spikes don't flatten everything else
+	float max_value = 0;
+	for (int i = 0; i < zones; i++) {
+		float v = prof_percentile(i, active_thrd, 0.99);
 		if (v > max_value) max_value = v;
-	}*/
+	}
+	if (max_value <= 0) max_value = 1e9/75.0; // ns
+	max_value *= 1.1;
 
 	float plot_scale = item.height / max_value;
 
-	for (int i = 0; i < PROF_ENTRIES_COUNT; i++) {
+	// oldest slot is at the published position
+	int pos = prof_summary_pos(active_thrd);
+
+	for (int i = 0; i < zones; i++) {
 		struct prof_stats* stat = prof_summary(i, active_thrd);
+		if (!stat) break;
 		Color color = prof_color(i);
 		for (int ix = 0; ix < PROF_HISTORY_LEN-1; ix++) {
+			int s1 = (pos + ix) % PROF_HISTORY_LEN;
+			int s2 = (pos + ix + 1) % PROF_HISTORY_LEN;
 			float x = item.x + ix * item.width / PROF_HISTORY_LEN;
 			float x2 = item.x + (ix+1) * item.width / PROF_HISTORY_LEN;
-			float y  = stat[ix].owntime*plot_scale;
+			float y  = stat[s1].owntime*plot_scale;
 			y = item.y + item.height - y;
-			float y2 = stat[ix+1].owntime*plot_scale;
+			float y2 = stat[s2].owntime*plot_scale;
 			y2 = item.y + item.height - y2;
 			DrawLine(x, y, x2, y2, color);
 		}
 	}
 }
 
+/*
+ * Last values of all counters, summed over all threads.
+ */
+void drawCounters(Rectangle rec) {
+	int n = prof_counters_count(), threads = prof_threads_count();
+	for (int i = 0; i < n; i++) {
+		int64_t v = 0;
+		for (int t = 0; t < threads; t++) {
+			int64_t* h = prof_counter_history(i, t);
+			int pos = prof_summary_pos(t);
+			if (h) v += h[(pos + PROF_HISTORY_LEN - 1) % PROF_HISTORY_LEN];
+		}
+		DrawText(TextFormat("%s : %lli", prof_counter_name(i), (long long)v),
+			rec.x, rec.y + i * 10, 10, WHITE);
+	}
+	if (!n) DrawText("no counters", rec.x, rec.y, 10, GRAY);
+}
+
+/*
+ * Percentiles of all zones of the main thread, and the worst frames.
+ */
+void drawHitches(Rectangle rec) {
+	int y = rec.y;
+	DrawText("zone : p50 / p95 / p99 (ms)", rec.x, y, 10, GRAY);
+	y += 10;
+	for (int i = 0; i < prof_zones_count(); i++) {
+		uint64_t p99 = prof_percentile(i, 0, 0.99);
+		if (!p99) continue; // never called
+		DrawText(TextFormat("%s : %.3f / %.3f / %.3f", prof_entries_names[i],
+			prof_percentile(i, 0, 0.50) / 1e6, prof_percentile(i, 0, 0.95) / 1e6,
+			p99 / 1e6), rec.x, y, 10, prof_color(i));
+		y += 10;
+	}
+
+	Rectangle item = {rec.x + rec.width - 60, rec.y, 50, 12};
+	if (GuiButton(item, "clear")) prof_hitches_clear();
+
+	static struct prof_hitch list[PROF_HITCHES_MAX];
+	int n = prof_hitches_get(list, PROF_HITCHES_MAX);
+	y += 5;
+	DrawText(TextFormat("worst frames (%i) :", n), rec.x, y, 10, GRAY);
+	y += 10;
+
+	for (int i = 0; i < n; i++) {
+		struct prof_hitch* h = list + i;
+		// three zones with biggest own time
+		int top[3] = {-1, -1, -1};
+		for (int z = 0; z < prof_zones_count(); z++) {
+			for (int k = 0; k < 3; k++) {
+				if (top[k] < 0 || h->data[z].owntime > h->data[top[k]].owntime) {
+					for (int m = 2; m > k; m--) top[m] = top[m-1];
+					top[k] = z;
+					break;
+				}
+			}
+		}
+		const char* s = TextFormat("%.1fms t%i #%u :", h->time / 1e6, h->thread, h->frame);
+		DrawText(s, rec.x, y, 10, WHITE);
+		int x = rec.x + MeasureText(s, 10) + 5;
+		for (int k = 0; k < 3; k++) {
+			if (top[k] < 0 || !h->data[top[k]].owntime) break;
+			s = TextFormat("%s %.1f", prof_entries_names[top[k]], h->data[top[k]].owntime / 1e6);
+			DrawText(s, x, y, 10, prof_color(top[k]));
+			x += MeasureText(s, 10) + 5;
+		}
+		y += 10;
+	}
+}
@@ -18,6 +18,8 @@
 
 #pragma once
 #include <raylib.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 #define PROF_HISTORY_LEN 255
 
@@ -47,12 +49,58 @@ enum prof_entries {
 	PROF_LOAD_SAVE,
 	PROF_GENERATOR,
 	PROF_DISK,
-	PROF_ENTRIES_COUNT
+	PROF_OTHER, // zones that did not fit go here
+	PROF_ENTRIES_COUNT // builtin ones
 };
 
-extern const char* prof_entries_names[];
+/*
+ * ...but you can register more zones at runtime, up to PROF_ENTRIES_MAX
+ * (including builtin ones). Names are NOT copied, use string literals!
+ * Returns zone handle for prof_begin(). Same name gives the same handle.
+ * Registration is slow : use PROF_BEGIN_ZONE(), it caches the handle.
+ */
+#define PROF_ENTRIES_MAX 64
+int prof_zone(const char* name);
+int prof_zones_count();
 
-#define PROF_THREADS_MAX 5
+extern const char* prof_entries_names[PROF_ENTRIES_MAX];
+
+#define PROF_BEGIN_ZONE(name) do {\
+	static int prof_handle_ = -1;\
+	if (prof_handle_ < 0) prof_handle_ = prof_zone(name);\
+	prof_begin(prof_handle_);\
+} while (0)
+
+/*
+ * Numeric counters. Counter of kind PROF_KIND_COUNT is accumulated by
+ * prof_count() and reset at prof_step(). PROF_KIND_GAUGE keeps the last
+ * value, set by prof_gauge(). Both are stored per thread, and snapshotted
+ * into the history at prof_step(). Names are not copied too.
+ * Returns -1 when there is no more space (counter is ignored then).
+ */
+#define PROF_COUNTERS_MAX 32
+enum prof_counter_kind {
+	PROF_KIND_COUNT,
+	PROF_KIND_GAUGE
+};
+
+int  prof_counter(const char* name, int kind);
+int  prof_counters_count();
+const char* prof_counter_name(int counter);
+void prof_count(int counter, int64_t v);
+void prof_gauge(int counter, int64_t v);
+
+#define PROF_COUNT(name, v) do {\
+	static int prof_handle_ = -2;\
+	if (prof_handle_ == -2) prof_handle_ = prof_counter(name, PROF_KIND_COUNT);\
+	prof_count(prof_handle_, v);\
+} while (0)
+
+#define PROF_GAUGE(name, v) do {\
+	static int prof_handle_ = -2;\
+	if (prof_handle_ == -2) prof_handle_ = prof_counter(name, PROF_KIND_GAUGE);\
+	prof_gauge(prof_handle_, v);\
+} while (0)
 
 /*
  * the SUMMARY time of every entry SHOULD be equal to sum of it's own execution
@@ -64,19 +112,20 @@ extern const char* prof_entries_names[];
  * running, not any subentries.
  */
 struct prof_stats {
-	float owntime; // how long this entry was executed (subentries are EXCLUDED)
-	float sumtime; // how long this entry and all CALLED subentries are executed
+	uint64_t owntime; // ns, how long this entry was executed (subentries are EXCLUDED)
+	uint64_t sumtime; // ns, how long this entry and all CALLED subentries are executed
 	int   ncalls;  // number of "calls" to this entry
 };
 
-// implementation of very presize and stable clocksource
+// implementation of very presize and stable clocksource, in nanoseconds
 // DON'T USE A DEFAULT clock() FUNCTION FROM LIBC! IT'S AWFUL!
-// I am using the GetTime() function from raylib here.
-double prof_clock(); 
+// Monotonic clock (or TSC with PROF_USE_TSC) is used, no window needed.
+uint64_t prof_clock(); 
 
 /* 
  * Every thread, that going to use this profiler, must be properly
- * registered and unregistered!
+ * registered and unregistered! There is no limit on threads count,
+ * contexts of unregistered threads are reused.
  */
 void prof_register_thread();
 void prof_unregister_thread();
@@ -90,20 +139,63 @@ void prof_end();
 /*
  * Get statictics about some entry.
  * Length of this array is specified in PROF_HISTORY_LEN macro.
- * I don't think that knowing current position of the prfiler
- * in this array is useful... THat's why i am not doing that :D
- * You can draw plot right from this, it looks okay.
+ * It's a ring : prof_summary_pos() returns position of the oldest
+ * slot (next to be written). Slot right before it is the newest
+ * one. May be called from any thread. Returns NULL if thread with
+ * this index was never registered.
  */
 struct prof_stats* prof_summary(int entry, int thread);
+int prof_summary_pos(int thread);
+
+/*
+ * Percentile (p in 0..1) of the entry summary time over the history, ns.
+ * Calculated from the rolling log scale histogram, so it's not exact
+ * (less than 25% error). Only steps where entry was called are counted.
+ */
+#define PROF_BUCKETS 256
+uint64_t prof_percentile(int entry, int thread, float p);
+
+/*
+ * Hitches : steps, where time of all top level zones is bigger than the
+ * threshold (33 ms by default). Full breakdown of the worst ones is kept.
+ * prof_hitches_get() copies them to out, worst first, returns count.
+ */
+#define PROF_HITCHES_MAX 8
+struct prof_hitch {
+	uint64_t time;   // ns
+	uint32_t frame;  // step number of the thread
+	int      thread;
+	struct prof_stats data[PROF_ENTRIES_MAX];
+};
+
+void prof_hitch_threshold(uint64_t ns);
+int  prof_hitches_get(struct prof_hitch* out, int max);
+void prof_hitches_clear();
+
+// same, for counters. Uses the same position
+int64_t* prof_counter_history(int counter, int thread);
+
+// number of thread contexts (main thread is 0)
+int prof_threads_count();
 
 /*
  * Call this at the end of the "Game tick", or just to finally write results
  * to the history.
  *
- * Remember about floating point presizion, don't make pauses between this
- * very long.
- *
  * THIS FUNCTION REQUIRES FOR ALL PUSHED ENTRIES TO BE POPPED OUT!
  * Aka, this function MAY be ONLY called after all profiling zones are done.
  */
 void prof_step();
+
+/*
+ * Trace recording : every begin/end is recorded with timestamp and
+ * thread into per-thread rings (last 65536 events of every thread).
+ * Dump writes Chrome Trace Event JSON, open it in Perfetto or in
+ * chrome://tracing. Returns false on error.
+ *
+ * Set PIXELBOX_TRACE=path/to/trace.json environment variable to enable
+ * tracing from the start and dump it at exit.
+ */
+void prof_trace_enable(bool enable);
+bool prof_trace_enabled();
+bool prof_trace_dump(const char* path);
@@ -56,6 +56,16 @@ void setWorldSeed(int64_t seed) {
  * END OF MIT-LICENSED CODE!!!!
  */
 
+// every value gives 8 bytes : byte i is from value start + i/8, low
+// byte first. Written one by one, so it does not depend on endianness
+void rngFillBytes(uint64_t key, uint64_t start, uint8_t* out, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		uint64_t v = rngAt(key, start + i / 8);
+		for (size_t k = 0; k < 8 && i + k < n; k++)
+			out[i + k] = (uint8_t)(v >> (8 * k));
+	}
+}
+
 // noise1234
 //
 // Author: Stefan Gustavson, 2003-2005
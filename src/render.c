@@ -21,6 +21,11 @@
 #include "implix.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include "settings.h"
+#include "profiler.h"
+#include "simulation.h"
+#include "lod.h"
 
 static const char* fragment =
 #ifdef PLATFORM_WEB
@@ -73,93 +78,212 @@ NULL
 ;
 
 #define BUILDERWIDTH 64
-#define RENDER_MAX   BUILDERWIDTH*BUILDERWIDTH
+#define PAGE_SLOTS   BUILDERWIDTH*BUILDERWIDTH
+#define PAGES_MAX    (VIEW_MAX/PAGE_SLOTS) // whole view fits in one pool
+#define RENDER_MAX   PAGE_SLOTS*PAGES_MAX
 
 struct gitem { // graphical item (chunk)
 	union packpos pos;
 	struct gitem* next;
+	uint32_t version; // of the uploaded chunk data
+	uint8_t page; // index of the page in the pool
 	bool used;
 };
 
-struct {
-	Shader  shader;
+#include "atlas.h"
+
+/*
+ * Atlas page : one texture with BUILDERWIDTH*BUILDERWIDTH tiles.
+ * Pages are allocated on demand, when all previous pages are full,
+ * and released when they have no used items left. Items are drawn
+ * page by page, so every page is one texture bind (and one batch).
+ */
+struct apage {
 	Texture texture;
-	struct gitem items[RENDER_MAX];
+	struct atlas atlas; // CPU mirror of the texture
+	struct gitem items[PAGE_SLOTS];
+	uint16_t freelist[PAGE_SLOTS]; // stack of free item indices
+	uint16_t drawlist[PAGE_SLOTS]; // items visible in this frame
+	int freecount, drawcount;
+};
+
+struct apool { // growable multi-page atlas
+	struct apage* pages[PAGES_MAX];
 	struct gitem* map[MAPLEN];
-	uint16_t freeitem; // index of free item
-	uint16_t requests;
+	int tile; // in pixels
+	int used; // items in use over all pages
+};
+
+struct vrect { // in chunks, inclusive
+	int32_t x0, y0, x1, y1;
+};
+
+enum { // rendering modes
+	RMODE_NONE,
+	RMODE_ATLAS, // every chunk is a tile in the atlas pool
+	RMODE_TORUS, // see updateTorus()
+	RMODE_LOD1,  // 2x2 downsampled tiles, see lod.h
+	RMODE_LOD2   // 4x4 downsampled tiles
+};
+
+// zoom, at and below which LOD levels are used
+#define LOD_ZOOM1 0.5
+#define LOD_ZOOM2 0.25
+
+struct {
+	Shader  shader;
+	struct apool pool;
+	struct apool lodpool[LOD_LEVELS];
+	struct vrect view; // visible rectangle of the last frame
+	bool has_view;
+	int mode;
+	uint32_t frame;
+	int uploads; // UpdateTextureRec() calls in the last frame
 } Builder;
 
-static char unused[CHUNK_WIDTH*BUILDERWIDTH*CHUNK_WIDTH*BUILDERWIDTH] = {0};
+static struct apage* newPage(int tile) {
+	struct apage* p = calloc(1, sizeof(struct apage));
+	if (!p) return NULL;
+
+	if (!initAtlas(&p->atlas, tile, BUILDERWIDTH, BUILDERWIDTH)) {
+		free(p);
+		return NULL;
+	}
 
-void initBuilder() {
 	Image img  = {0};
-	img.data   = unused;
+	img.data   = p->atlas.pixels;
 	img.mipmaps = 1;
 	img.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE;
-	img.width  = CHUNK_WIDTH*BUILDERWIDTH;
-	img.height = CHUNK_WIDTH*BUILDERWIDTH;
-	Builder.texture = LoadTextureFromImage(img);
+	img.width  = tile*BUILDERWIDTH;
+	img.height = tile*BUILDERWIDTH;
+	p->texture = LoadTextureFromImage(img);
+
+	if (!IsTextureReady(p->texture)) {
+		perror("Can't make texture for atlas page!");
+		freeAtlas(&p->atlas);
+		free(p);
+		return NULL;
+	}
+	SetTextureFilter(p->texture, TEXTURE_FILTER_POINT);
+
+	for (int i = 0; i < PAGE_SLOTS; i++) {
+		p->freelist[i] = PAGE_SLOTS - 1 - i; // 0 is on top
+	}
+	p->freecount = PAGE_SLOTS;
+	return p;
+}
+
+static void freePage(struct apage* p) {
+	UnloadTexture(p->texture);
+	freeAtlas(&p->atlas);
+	free(p);
+}
 
-	if (!IsTextureReady(Builder.texture)) {
+static void initPool(struct apool* pool, int tile) {
+	memset(pool, 0, sizeof(struct apool));
+	pool->tile = tile;
+}
+
+static void freePool(struct apool* pool) {
+	for (int i = 0; i < PAGES_MAX; i++) {
+		if (pool->pages[i]) freePage(pool->pages[i]);
+	}
+	initPool(pool, pool->tile);
+}
+
+// releases unused pages. First page is kept forever
+static void collectPages(struct apool* pool) {
+	for (int i = 1; i < PAGES_MAX; i++) {
+		struct apage* p = pool->pages[i];
+		if (p && p->freecount == PAGE_SLOTS) {
+			freePage(p);
+			pool->pages[i] = NULL;
+		}
+	}
+}
+
+void initBuilder() {
+	initPool(&Builder.pool, CHUNK_WIDTH);
+	for (int i = 0; i < LOD_LEVELS; i++)
+		initPool(Builder.lodpool + i, lodTileWidth(i + 1));
+	initLod();
+	Builder.has_view = false;
+	Builder.mode = RMODE_NONE;
+
+	// first page is allocated right away, to catch errors early
+	Builder.pool.pages[0] = newPage(CHUNK_WIDTH);
+	if (!Builder.pool.pages[0]) {
 		perror("Can't make texture for TextureBuilder! Aborting...");
 		abort();
 	}
 
 	Builder.shader = LoadShaderFromMemory(vertex, fragment);
 	if (!IsShaderReady(Builder.shader)) abort();
-	SetTextureFilter(Builder.texture, TEXTURE_FILTER_POINT);
 }
 
+static void freeTorus();
+static void freeVisible(void);
+
 void freeBuilder() {
-	UnloadTexture(Builder.texture);
 	UnloadShader(Builder.shader);
-	for (int i = 0; i < RENDER_MAX; i++)
-		Builder.items[i].used = false;
-	for (int i = 0; i < MAPLEN; i++)
-		Builder.map[i] = NULL;
-	Builder.freeitem = 0;
-}
-
-static bool collides(struct gitem* o, int32_t x, int32_t y, int32_t x2, int32_t y2) {
-	return (
-		(int32_t)o->pos.axis[0] <= x2 &&
-    (int32_t)o->pos.axis[0] >= x  &&
-    (int32_t)o->pos.axis[1] <= y2 &&
-    (int32_t)o->pos.axis[1] >= y
-	);
+	freePool(&Builder.pool);
+	for (int i = 0; i < LOD_LEVELS; i++)
+		freePool(Builder.lodpool + i);
+	freeLod();
+	freeTorus();
+	freeVisible();
+	Builder.has_view = false;
+	Builder.mode = RMODE_NONE;
 }
 
 #include "game.h"
 
 void debugRender(Rectangle rec) {
-	for (int i = 0; i < RENDER_MAX; i++) {
+	int pages = 0;
+	for (int n = 0; n < PAGES_MAX; n++) {
+		struct apage* p = Builder.pool.pages[n];
+		if (!p) continue;
+
+		float px = rec.x + pages * (BUILDERWIDTH + 2);
+		if (px + BUILDERWIDTH > rec.x + rec.width) break;
+		pages++;
+
+		for (int i = 0; i < PAGE_SLOTS; i++) {
 			int x = i % BUILDERWIDTH;
 			int y = i / BUILDERWIDTH;
-			struct gitem* o = Builder.items + i;
-			DrawPixel(rec.x + x, rec.y + y, o->used ? (GREEN) : GRAY);
+			struct gitem* o = p->items + i;
+			DrawPixel(px + x, rec.y + y, o->used ? (GREEN) : GRAY);
+		}
+
+		if (p->freecount) { // next item to be allocated
+			int i = p->freelist[p->freecount - 1];
+			DrawPixel(px + i % BUILDERWIDTH, rec.y + i / BUILDERWIDTH, YELLOW);
+		}
 	}
 
-	int x = Builder.freeitem % BUILDERWIDTH;
-	int y = Builder.freeitem / BUILDERWIDTH;
-	DrawPixel(rec.x + x, rec.y + y, YELLOW);
+	rec.y += BUILDERWIDTH + 5;
+	DrawText(TextFormat("items : %i, uploads : %i, lod : %i (mode %i)",
+		Builder.pool.used, Builder.uploads, getLodCount(), Builder.mode),
+		rec.x, rec.y, 10, WHITE);
 
-	rec.x += BUILDERWIDTH + 5;
+	rec.y += 15;
 	for (int i = 0; i < MAPLEN; i++) {
-		struct gitem *o = Builder.map[i];
+		struct gitem *o = Builder.pool.map[i];
 		int j = 0;
 		while (o) {
-			DrawPixel(rec.x + j, rec.y + i, PINK);
+			DrawPixel(rec.x + i, rec.y + j, PINK);
 			o = o->next;
 			j++;
 		}
 	}
 }
 
+#include <assert.h>
+
 // manip
-static struct gitem* findItem(union packpos pos) {
+static struct gitem* findItem(struct apool* pool, union packpos pos) {
 	uint16_t i = MAPHASH(pos.pack);
-	struct gitem* o = Builder.map[i];
+	struct gitem* o = pool->map[i];
 	
 	while (o) {
 		if (o->pos.pack == pos.pack) return o;
@@ -169,32 +293,49 @@ static struct gitem* findItem(union packpos pos) {
 	return NULL;
 }
 
-struct gitem* newItem(union packpos pos) {
-	repeat:
-	if (Builder.freeitem >= RENDER_MAX) return NULL;
-	struct gitem* o = Builder.items + (Builder.freeitem++);
-	if (o->used) goto repeat;
+static struct apage* freePageOf(struct apool* pool) {
+	int hole = -1;
+	for (int i = 0; i < PAGES_MAX; i++) {
+		struct apage* p = pool->pages[i];
+		if (p && p->freecount) return p; // lower pages first
+		if (!p && hole < 0) hole = i;
+	}
+	if (hole < 0) return NULL; // all pages are full
+
+	pool->pages[hole] = newPage(pool->tile);
+	return pool->pages[hole]; // may be NULL
+}
+
+static struct gitem* newItem(struct apool* pool, union packpos pos) {
+	struct apage* p = freePageOf(pool);
+	if (!p) return NULL; // atlas is full
+
+	struct gitem* o = p->items + p->freelist[--p->freecount];
+	assert(!o->used && "render free list corrupted!");
 	o->used = 1;
 	o->pos.pack = pos.pack;
+	for (o->page = 0; pool->pages[o->page] != p; o->page++) {}
 
 	uint16_t i = MAPHASH(pos.pack);
-	o->next = Builder.map[i];
-	Builder.map[i] = o;
+	o->next = pool->map[i];
+	pool->map[i] = o;
+	pool->used++;
 	return o;
 }
 
-static struct gitem* removeItem(struct gitem* f) {
+static struct gitem* removeItem(struct apool* pool, struct gitem* f) {
 	if (!f) return NULL;
 	uint16_t i = MAPHASH(f->pos.pack);	
-	struct gitem* o = Builder.map[i], *p = NULL;
+	struct gitem* o = pool->map[i], *p = NULL;
 
 	while (o) {
 		if (o == f) {
 			if (p) p->next = o->next;
-			else Builder.map[i] = o->next;
+			else pool->map[i] = o->next;
 			o->used = false;
-			uint16_t idx = (uint16_t)(o - Builder.items);
-			if (idx < Builder.freeitem) Builder.freeitem = idx;
+			struct apage* page = pool->pages[o->page];
+			page->freelist[page->freecount++] = (uint16_t)(o - page->items);
+			pool->used--;
 			return o->next;
 		};
 		p = o;
@@ -204,61 +345,160 @@ static struct gitem* removeItem(struct gitem* f) {
 	return NULL;
 }
 
-static void updateData(int index, struct chunk* c) {
-	int x = index % BUILDERWIDTH;
-	int y = index / BUILDERWIDTH;
-	UpdateTextureRec(
-		Builder.texture,
-		(Rectangle) {
-			x * CHUNK_WIDTH,
-			y*CHUNK_WIDTH,
-			CHUNK_WIDTH, CHUNK_WIDTH
-		},
-		getChunkData(c, MODE_READ)
-	);
+// stage tile data into the atlas mirror. Uploaded in flushPool()
+static void updateData(struct apool* pool, struct gitem* o, const uint8_t* data) {
+	struct apage* p = pool->pages[o->page];
+	atlasPut(&p->atlas, (int)(o - p->items), data);
 }
 
-#include <assert.h>
+// upload all merged dirty spans of all pages at once
+static void flushPool(struct apool* pool) {
+	struct atlas_span span;
+	for (int i = 0; i < PAGES_MAX; i++) {
+		struct apage* p = pool->pages[i];
+		if (!p) continue;
+		while (atlasNextSpan(&p->atlas, &span)) {
+			UpdateTextureRec(
+				p->texture,
+				(Rectangle) {span.x, span.y, span.width, span.height},
+				span.data
+			);
+			Builder.uploads++;
+		}
+	}
+}
 
-static void collectItems(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+// item will be drawn in this frame
+static void drawItem(struct apool* pool, struct gitem* o) {
+	struct apage* p = pool->pages[o->page];
+	p->drawlist[p->drawcount++] = (uint16_t)(o - p->items);
+}
+
+// draws all items from drawlists, grouped by page, and cleans drawlists
+static void drawPool(struct apool* pool) {
+	const int tile = pool->tile;
+	for (int n = 0; n < PAGES_MAX; n++) {
+		struct apage* p = pool->pages[n];
+		if (!p) continue;
+		for (int j = 0; j < p->drawcount; j++) {
+			int i = p->drawlist[j];
+			struct gitem *o = p->items + i;
+			int x = i % BUILDERWIDTH;
+			int y = i / BUILDERWIDTH;
+			DrawTexturePro(
+					p->texture,
+					(Rectangle) {x*tile, y*tile, tile, tile},
+					(Rectangle) {
+						o->pos.axis[0] * CHUNK_WIDTH,
+						o->pos.axis[1] * CHUNK_WIDTH,
+						CHUNK_WIDTH, CHUNK_WIDTH
+					}, (Vector2){0, 0}, 0, WHITE);
+		}
+		p->drawcount = 0;
+	}
+}
+
+// removes ALL items. Slow, but needed only on mode switch
+static void flushItems(struct apool* pool) {
 	for (int i = 0; i < MAPLEN; i++) {
-		struct gitem *o = Builder.map[i];
+		struct gitem *o = pool->map[i];
 		while (o) {
 			assert(o->used && "render hashmap corrupted!");
-			// DEBUG
-			if (!collides(o, x0, y0, x1, y1)) {
-				 o = removeItem(o); // hehe
+			o = removeItem(pool, o); // hehe
+		}
+	}
+}
+
+/*
+ * Evicts items, that were in the old visible rectangle, but are not in
+ * the new one. Every item is always inside of the last visible rectangle,
+ * so nothing else may be offscreen. Cost is proportional to the number
+ * of chunks leaving the view, not to the number of chunks on the screen.
+ */
+static void evictItems(struct apool* pool, struct vrect o, struct vrect n) {
+	for (int32_t y = o.y0; y <= o.y1; y++) {
+		bool inside = y >= n.y0 && y <= n.y1;
+		for (int32_t x = o.x0; x <= o.x1; x++) {
+			if (inside && x >= n.x0 && x <= n.x1) {
+				x = n.x1; // skip intersection
+				continue;
+			}
+			union packpos pos;
+			pos.axis[0] = x;
+			pos.axis[1] = y;
+			removeItem(pool, findItem(pool, pos));
+		}
+	}
+}
+
+/*
+ * Items of the visible rectangle, row by row. They are collected under
+ * the world lock, and drawn after unlockWorld(), so the simulation never
+ * waits for us to talk with raylib. NULL is a chunk we don't have yet.
+ */
+static struct {
+	struct gitem** items;
+	size_t cap;
+} Visible;
+
+static struct gitem** getVisible(struct vrect view) {
+	size_t len = (size_t)(view.x1 - view.x0 + 1) * (view.y1 - view.y0 + 1);
+	if (len > Visible.cap) {
+		struct gitem** items = realloc(Visible.items, len * sizeof(*items));
+		if (!items) {
+			perror("Can't allocate visible items!");
+			return NULL;
+		}
+		Visible.items = items;
+		Visible.cap = len;
+	}
+	return Visible.items;
+}
+
+static void freeVisible(void) {
+	free(Visible.items);
+	Visible.items = NULL;
+	Visible.cap = 0;
+}
+
+// softGenerate() needs no lock, it's just a worldgen guess
+static void drawVisible(struct apool* pool, struct vrect view) {
+	struct gitem** o = Visible.items;
+	for (int32_t y = view.y0; y <= view.y1; y++) {
+		for (int32_t x = view.x0; x <= view.x1; x++, o++) {
+			if (*o) {
+				drawItem(pool, *o);
+				continue;
 			}
-			else o = o->next;
+			DrawRectangleRec(
+				(Rectangle){x * CHUNK_WIDTH, y * CHUNK_WIDTH, CHUNK_WIDTH, CHUNK_WIDTH},
+				getPixelColor(softGenerate(x, y))
+			);
 		}
 	}
 }
 
 static struct gitem* getItem(union packpos pos) {
-	struct gitem* o = findItem(pos);
+	struct apool* pool = &Builder.pool;
+	struct gitem* o = findItem(pool, pos);
 
 	if (o) { // founded! do some important stuff...
 
 		// fast path
 		struct chunk* c = findChunk(&World.map, pos.axis[0], pos.axis[1]);
-		assert(c != NULL);
-		/*{ // oh fuck!
-			removeItem(o);
-			Builder.requests--;
-			return NULL; 
-		}*/
-		c->usagefactor = CHUNK_USAGE_VALUE;
-		
-		if (c->is_changed) {
-			updateData((int)(o - Builder.items), c); // nice
+		if (c) {
+			c->usagefactor = CHUNK_USAGE_VALUE;
+			if (c->version != o->version) {
+				updateData(pool, o, getChunkData(c, MODE_READ)); // nice
+				o->version = c->version;
+			}
+			return o;
 		}
-		return o;
+		// GC runs on the simulation thread, and a slow frame may lose it
+		removeItem(pool, o);
 	}
 
 	// else create new guy!
-	Builder.requests++;
-	if (Builder.requests >= RENDER_MAX) return NULL; // ok
-
 	struct chunk* c;
 
 	c = getWorldChunk(pos.axis[0], pos.axis[1]);
@@ -266,79 +506,357 @@ static struct gitem* getItem(union packpos pos) {
 		return NULL;
 	}
 
-	o = newItem(pos);
-	if (!o) return NULL; // should not happen
+	o = newItem(pool, pos);
+	if (!o) return NULL; // all pages are full
 
-	updateData((int)(o - Builder.items), c);
+	updateData(pool, o, getChunkData(c, MODE_READ));
+	o->version = c->version;
 	return o;
 }
 
-#define swap(a, b) {do {int t = a; a = b; b = t;} while(0);}
+/*
+ * Toroidal rendering mode.
+ *
+ * Visible area lives in one wrap-around texture, where chunk (x, y) is
+ * always stored at tile (x mod width, y mod width). When camera moves,
+ * most of the tiles are already in place, so only newly exposed chunk
+ * columns and rows (and changed chunks) are written. And since texture
+ * is repeated, whole world layer is drawn as ONE textured quad.
+ *
+ * If view does not fit in TORUS_MAX chunks, atlas mode is used instead.
+ */
 
-void updateRender(Camera2D cam) {
-	Builder.requests = Builder.freeitem;
-	
-	// get rectangle
-	int64_t x0 = (GetScreenToWorld2D((Vector2){0, 0}, cam).x)/ CHUNK_WIDTH - 1;
-	int64_t x1 = (GetScreenToWorld2D((Vector2){GetScreenWidth(), 0}, cam).x) / CHUNK_WIDTH;
-	int64_t y0 = (GetScreenToWorld2D((Vector2){0, 0}, cam).y) / CHUNK_WIDTH - 1;
-	int64_t y1 = (GetScreenToWorld2D((Vector2){0, GetScreenHeight()}, cam).y) / CHUNK_WIDTH;
-	if (x1 < x0) swap(x1, x0);
-	if (y1 < y0) swap(y1, y0);
+#define TORUS_MIN 32
+#define TORUS_MAX 256 // 4096x4096 texture
 
-	// collect garbage :З
-	collectItems(x0, y0, x1, y1);
+enum {
+	TSLOT_NONE, // never written/invalid
+	TSLOT_GUESS, // placeholder is not written yet, see updateTorus()
+	TSLOT_SOFT, // softGenerate() placeholder
+	TSLOT_REAL  // real chunk data
+};
 
-	// add chunks in visible range
+struct tslot {
+	union packpos pos;
+	uint32_t version;
+	uint8_t  kind;
+};
+
+static struct {
+	Texture texture;
+	struct atlas atlas;
+	struct tslot* slots;
+	int width; // in chunks, pow of 2
+} Torus;
+
+static void freeTorus() {
+	if (Torus.width) UnloadTexture(Torus.texture);
+	freeAtlas(&Torus.atlas);
+	free(Torus.slots);
+	Torus.slots = NULL;
+	Torus.width = 0;
+}
+
+// (re)creates torus texture, if view does not fit in it
+static bool prepareTorus(int64_t w, int64_t h) {
+	int64_t need = w > h ? w : h;
+	if (need > TORUS_MAX) return false; // too big
+	if (need <= Torus.width) return true; // fits
+
+	int width = TORUS_MIN;
+	while (width < need) width *= 2;
+
+	freeTorus();
+	if (!initAtlas(&Torus.atlas, CHUNK_WIDTH, width, width)) return false;
+	Torus.slots = calloc(width*width, sizeof(struct tslot));
+	if (!Torus.slots) {
+		freeAtlas(&Torus.atlas);
+		return false;
+	}
+
+	Image img  = {0};
+	img.data   = Torus.atlas.pixels;
+	img.mipmaps = 1;
+	img.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE;
+	img.width  = CHUNK_WIDTH*width;
+	img.height = CHUNK_WIDTH*width;
+	Torus.texture = LoadTextureFromImage(img);
+
+	if (!IsTextureReady(Torus.texture)) {
+		perror("Can't make texture for toroidal rendering!");
+		freeAtlas(&Torus.atlas);
+		free(Torus.slots);
+		Torus.slots = NULL;
+		return false;
+	}
+
+	SetTextureFilter(Torus.texture, TEXTURE_FILTER_POINT);
+	SetTextureWrap(Torus.texture, TEXTURE_WRAP_REPEAT);
+	Torus.width = width;
+	return true;
+}
+
+static void updateTorus(int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+	const int mask = Torus.width - 1;
+	uint8_t soft[CHUNK_WIDTH*CHUNK_WIDTH];
+
+	lockWorld(); // only while we copy chunks into the atlas mirror
 	for (int64_t y = y0; y <= y1; y++) {
 		for (int64_t x = x0; x <= x1; x++) {
 			union packpos pos;
 			pos.axis[0] = x;
 			pos.axis[1] = y;
-			struct gitem* o = NULL;
-
-			o = getItem(pos);
 
-			float rx = x * CHUNK_WIDTH;
-			float ry = y * CHUNK_WIDTH;
+			int index = (x & mask) + (y & mask) * Torus.width;
+			struct tslot* t = Torus.slots + index;
+			struct chunk* c = getWorldChunk(x, y); // keeps chunk alive
 
-			if (!o) {
-				DrawRectangleRec(
-					(Rectangle){rx, ry, CHUNK_WIDTH, CHUNK_WIDTH},
-					getPixelColor(softGenerate(x, y))
-				);
+			if (c == &empty) { // still loading, guessed after unlockWorld()
+				if (t->kind == TSLOT_SOFT && t->pos.pack == pos.pack) continue;
+				t->kind = TSLOT_GUESS;
+				t->pos  = pos;
 				continue;
-			} 
+			}
 
-			// else if this is valid chunk... do nothing
+			if (t->kind == TSLOT_REAL && t->pos.pack == pos.pack &&
+					t->version == c->version) continue; // in place
+
+			atlasPut(&Torus.atlas, index, getChunkData(c, MODE_READ));
+			t->kind    = TSLOT_REAL;
+			t->pos     = pos;
+			t->version = c->version;
 		}
 	}
+	unlockWorld();
+
+	for (int64_t y = y0; y <= y1; y++) {
+		for (int64_t x = x0; x <= x1; x++) {
+			int index = (x & mask) + (y & mask) * Torus.width;
+			struct tslot* t = Torus.slots + index;
+			if (t->kind != TSLOT_GUESS) continue;
+			memset(soft, softGenerate(x, y), sizeof(soft));
+			atlasPut(&Torus.atlas, index, soft);
+			t->kind = TSLOT_SOFT;
+		}
+	}
+
+	struct atlas_span span;
+	while (atlasNextSpan(&Torus.atlas, &span)) {
+		UpdateTextureRec(
+			Torus.texture,
+			(Rectangle) {span.x, span.y, span.width, span.height},
+			span.data
+		);
+		Builder.uploads++;
+	}
+
+	// texture repeats itself, so source rectangle is just a world rect
+	Rectangle rec = {
+		x0 * CHUNK_WIDTH, y0 * CHUNK_WIDTH,
+		(x1 - x0 + 1) * CHUNK_WIDTH, (y1 - y0 + 1) * CHUNK_WIDTH
+	};
 
 	BeginShaderMode(Builder.shader);
-	for (int i = 0; i < MAPLEN; i++) {
-		struct gitem *o = Builder.map[i];
-		while (o) {
-			int i = (int)(o - Builder.items);
-			int x = i % BUILDERWIDTH;
-			int y = i / BUILDERWIDTH;
-			assert(collides(o, x0, y0, x1, y1));
-			DrawTextureRec(
-					Builder.texture,
-					(Rectangle) {
-						x*CHUNK_WIDTH,
-						y*CHUNK_WIDTH,
-						CHUNK_WIDTH,
-						CHUNK_WIDTH
-					}, 
-					(Vector2) {
-						o->pos.axis[0] * CHUNK_WIDTH,
-						o->pos.axis[1] * CHUNK_WIDTH
-					}, WHITE);
-			o = o->next;
+	DrawTextureRec(Torus.texture, rec, (Vector2){rec.x, rec.y}, WHITE);
+	EndShaderMode();
+}
+
+// cleans up state of the current mode, since it's not kept alive by others
+static void switchMode(int mode) {
+	if (Builder.mode == mode) return;
+	switch (Builder.mode) {
+		case RMODE_ATLAS:
+			flushItems(&Builder.pool);
+			collectPages(&Builder.pool);
+		break;
+		case RMODE_TORUS: // chunks may be unloaded/changed while we're away
+			if (Torus.slots) 
+				memset(Torus.slots, 0, Torus.width*Torus.width*sizeof(struct tslot));
+		break;
+		case RMODE_LOD1:
+		case RMODE_LOD2: {
+			struct apool* pool = Builder.lodpool + (Builder.mode - RMODE_LOD1);
+			flushItems(pool);
+			collectPages(pool);
+		} break;
+		default: break;
+	}
+	Builder.has_view = false;
+	Builder.mode = mode;
+}
+
+/*
+ * Zoomed out view : coarse tiles from the LOD cache. Chunks are never
+ * pinned in memory there, see getLod().
+ */
+static void updateLod(int level, struct vrect view) {
+	struct apool* pool = Builder.lodpool + (level - 1);
+	if (Builder.has_view) evictItems(pool, Builder.view, view);
+	Builder.view = view;
+	Builder.has_view = true;
+
+	struct gitem** visible = getVisible(view);
+	if (!visible) return;
+
+	lockWorld();
+	for (int32_t y = view.y0; y <= view.y1; y++) {
+		for (int32_t x = view.x0; x <= view.x1; x++) {
+			union packpos pos;
+			pos.axis[0] = x;
+			pos.axis[1] = y;
+
+			struct lodentry* e = getLod(x, y, Builder.frame);
+			struct gitem* o = NULL;
+
+			if (e && e->known) {
+				o = findItem(pool, pos);
+				if (!o && (o = newItem(pool, pos))) {
+					updateData(pool, o, lodTile(e, level));
+					o->version = e->version;
+				} else if (o && o->version != e->version) {
+					updateData(pool, o, lodTile(e, level));
+					o->version = e->version;
+				}
+			}
+
+			*visible++ = o;
+		}
+	}
+	unlockWorld();
+
+	drawVisible(pool, view);
+	collectPages(pool);
+	flushPool(pool);
+	collectLod(Builder.frame);
+
+	BeginShaderMode(Builder.shader);
+	drawPool(pool);
+	EndShaderMode();
+}
+
+// chunks in the view of the screen, see updateRender()
+static int64_t viewSize(float zoom) {
+	int64_t w = GetScreenWidth() / (CHUNK_WIDTH * zoom) + 3;
+	int64_t h = GetScreenHeight() / (CHUNK_WIDTH * zoom) + 3;
+	return w * h;
+}
+
+/*
+ * Zoom, below which view does not fit in VIEW_MAX chunks. It is
+ * MIN_ZOOM on most screens, and grows only on the really big ones.
+ */
+float minZoom(void) {
+	float zoom = MIN_ZOOM;
+	while (viewSize(zoom) > VIEW_MAX) zoom *= 1.05;
+	return zoom;
+}
+
+#define swap(a, b) {do {int t = a; a = b; b = t;} while(0);}
+
+static void drawWorld(Camera2D cam, struct vrect view) {
+	const int64_t x0 = view.x0, y0 = view.y0, x1 = view.x1, y1 = view.y1;
+	Builder.frame++;
+	PROF_GAUGE("uploads/frame", Builder.uploads); // of the previous frame
+	Builder.uploads = 0;
+
+	if (cam.zoom <= LOD_ZOOM1) {
+		int level = cam.zoom <= LOD_ZOOM2 ? 2 : 1;
+		switchMode(level == 1 ? RMODE_LOD1 : RMODE_LOD2);
+		updateLod(level, view);
+		return;
+	}
+
+	if (conf_torus_render && prepareTorus(x1 - x0 + 1, y1 - y0 + 1)) {
+		switchMode(RMODE_TORUS);
+		updateTorus(x0, y0, x1, y1);
+		return;
+	}
+
+	// collect garbage :З
+	switchMode(RMODE_ATLAS);
+	if (Builder.has_view) evictItems(&Builder.pool, Builder.view, view);
+	Builder.view = view;
+	Builder.has_view = true;
+
+	struct gitem** visible = getVisible(view);
+	if (!visible) return;
+
+	// add chunks in visible range
+	lockWorld();
+	for (int64_t y = y0; y <= y1; y++) {
+		for (int64_t x = x0; x <= x1; x++) {
+			union packpos pos;
+			pos.axis[0] = x;
+			pos.axis[1] = y;
+			*visible++ = getItem(pos);
 		}
 	}
+	unlockWorld();
+
+	drawVisible(&Builder.pool, view);
+	collectPages(&Builder.pool);
+	flushPool(&Builder.pool); // one upload per dirty span, not per chunk
+
+	BeginShaderMode(Builder.shader);
+	drawPool(&Builder.pool);
 	EndShaderMode();
+}
 
+/*
+ * Simulation heat overlay : visible chunks are colored by their update
+ * cost (see struct chunk), relative to the hottest visible one. Toggled
+ * in the heat tab of the debug toolkit.
+ */
+bool heat_overlay = false;
+
+static void drawHeat(struct vrect view) {
+	static uint32_t* costs = NULL; // of the visible chunks, row by row
+	static size_t cap = 0;
+
+	size_t len = (size_t)(view.x1 - view.x0 + 1) * (view.y1 - view.y0 + 1);
+	if (len > cap) {
+		uint32_t* n = realloc(costs, len * sizeof(*costs));
+		if (!n) {
+			perror("Can't allocate heat overlay!");
+			return;
+		}
+		costs = n;
+		cap = len;
+	}
+
+	uint32_t max = 1, *o = costs;
+	lockWorld(); // only to copy costs, we draw after
+	for (int32_t y = view.y0; y <= view.y1; y++)
+		for (int32_t x = view.x0; x <= view.x1; x++) {
+			struct chunk* c = findChunk(&World.map, x, y);
+			*o = c ? c->cost : 0;
+			if (*o > max) max = *o;
+			o++;
+		}
+	unlockWorld();
+
+	o = costs;
+	for (int32_t y = view.y0; y <= view.y1; y++)
+		for (int32_t x = view.x0; x <= view.x1; x++, o++) {
+			if (!*o) continue;
+			float heat = *o / (float)max;
+			DrawRectangleRec(
+				(Rectangle){x * CHUNK_WIDTH, y * CHUNK_WIDTH, CHUNK_WIDTH, CHUNK_WIDTH},
+				Fade(ColorFromHSV(60 * (1 - heat), 1, 1), 0.15 + heat * 0.5)
+			);
+		}
 }
 
+void updateRender(Camera2D cam) {
+	// get rectangle
+	int64_t x0 = (GetScreenToWorld2D((Vector2){0, 0}, cam).x)/ CHUNK_WIDTH - 1;
+	int64_t x1 = (GetScreenToWorld2D((Vector2){GetScreenWidth(), 0}, cam).x) / CHUNK_WIDTH;
+	int64_t y0 = (GetScreenToWorld2D((Vector2){0, 0}, cam).y) / CHUNK_WIDTH - 1;
+	int64_t y1 = (GetScreenToWorld2D((Vector2){0, GetScreenHeight()}, cam).y) / CHUNK_WIDTH;
+	if (x1 < x0) swap(x1, x0);
+	if (y1 < y0) swap(y1, y0);
 
+	struct vrect view = {x0, y0, x1, y1};
+	drawWorld(cam, view);
+	if (heat_overlay) drawHeat(view);
+}
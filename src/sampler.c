@@ -0,0 +1,359 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // dladdr()
+#endif
+
+#include "sampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+bool startSampler(int hz) {(void)hz; return false;}
+void stopSampler() {}
+bool samplerRunning() {return false;}
+void resetSampler() {}
+void processSampler() {}
+int  samplerTop(struct sampler_symbol* out, int max) {(void)out; (void)max; return 0;}
+uint32_t samplerTotal() {return 0;}
+uint32_t samplerDropped() {return 0;}
+bool dumpSamplerFolded(const char* path) {(void)path; return false;}
+void initSampler() {}
+void freeSampler() {}
+
+#else
+
+#include <stdatomic.h>
+#include <signal.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+
+#define SLOTS_LEN   1024 // must be pow of 2!
+#define STACK_DEPTH 32
+#define STACK_SKIP  2 // signal handler and signal trampoline
+#define SYMLEN    4096  // must be pow of 2!
+#define PCLEN     16384 // must be pow of 2!
+#define STACKSLEN 8192  // must be pow of 2!
+
+enum {
+	SLOT_EMPTY,
+	SLOT_WRITING,
+	SLOT_READY
+};
+
+/*
+ * Slots are shared with the signal handler. Handler takes next slot with
+ * fetch_add, and owns it only if it was empty (CAS). Otherwise sample is
+ * dropped : nothing blocks in the signal handler, ever.
+ */
+struct sslot {
+	_Atomic int state;
+	int depth;
+	void* pc[STACK_DEPTH];
+};
+
+struct ssymbol { // by the function start address
+	void* addr;
+	const char* name;
+	uint32_t self, total;
+	uint32_t stamp; // sample, that counted this symbol last time
+};
+
+struct spc { // pc -> symbol cache, dladdr() is slow
+	void* pc;
+	struct ssymbol* sym;
+};
+
+struct sstack {
+	uint32_t hash;
+	uint32_t count;
+	int depth; // 0 if free
+	struct ssymbol* syms[STACK_DEPTH]; // leaf first
+};
+
+static struct sslot slots[SLOTS_LEN];
+static _Atomic uint32_t slots_head = 0;
+static _Atomic uint32_t dropped = 0;
+
+static struct {
+	struct ssymbol* syms; // SYMLEN
+	struct spc*   pcs;    // PCLEN
+	struct sstack* stacks; // STACKSLEN
+	uint32_t total;
+	int nsyms;
+	bool running;
+} S;
+
+static void handler(int sig, siginfo_t* info, void* uctx) {
+	(void)sig; (void)info; (void)uctx;
+	int saved = errno;
+
+	uint32_t i = atomic_fetch_add_explicit(&slots_head, 1, memory_order_relaxed);
+	struct sslot* s = slots + (i & (SLOTS_LEN-1));
+	int expected = SLOT_EMPTY;
+	if (atomic_compare_exchange_strong(&s->state, &expected, SLOT_WRITING)) {
+		s->depth = backtrace(s->pc, STACK_DEPTH);
+		atomic_store_explicit(&s->state, SLOT_READY, memory_order_release);
+	} else atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+
+	errno = saved;
+}
+
+static inline uint32_t hashptr(void* p) {
+	uint64_t v = (uintptr_t)p;
+	v ^= v >> 33;
+	v *= 0xff51afd7ed558ccdull;
+	v ^= v >> 33;
+	return v;
+}
+
+static struct ssymbol* getSymbol(void* addr, const char* name) {
+	uint32_t i = hashptr(addr) & (SYMLEN-1);
+	for (int n = 0; n < SYMLEN; n++, i = (i + 1) & (SYMLEN-1)) {
+		struct ssymbol* s = S.syms + i;
+		if (s->name && s->addr == addr) return s;
+		if (!s->name) {
+			if (S.nsyms >= SYMLEN/2) return NULL; // too full
+			s->addr = addr;
+			s->name = name;
+			S.nsyms++;
+			return s;
+		}
+	}
+	return NULL;
+}
+
+// static functions have no dynamic symbols, so they are counted as
+// the nearest exported function before them. Sorry :(
+static struct ssymbol* resolve(void* pc) {
+	uint32_t i = hashptr(pc) & (PCLEN-1);
+	for (int n = 0; n < 16; n++, i = (i + 1) & (PCLEN-1)) {
+		struct spc* c = S.pcs + i;
+		if (c->pc == pc) return c->sym;
+		if (!c->pc) break;
+	}
+
+	Dl_info info;
+	struct ssymbol* sym;
+	if (dladdr(pc, &info) && info.dli_sname) {
+		sym = getSymbol(info.dli_saddr, info.dli_sname);
+	} else if (dladdr(pc, &info) && info.dli_fname) {
+		const char* name = strrchr(info.dli_fname, '/');
+		sym = getSymbol(info.dli_fbase, name ? name + 1 : info.dli_fname);
+	} else sym = getSymbol(NULL, "??");
+
+	struct spc* c = S.pcs + (hashptr(pc) & (PCLEN-1));
+	for (int n = 0; n < 16 && c->pc; n++) {
+		c = S.pcs + ((c - S.pcs + 1) & (PCLEN-1));
+	}
+	if (!c->pc) { // else don't cache
+		c->pc  = pc;
+		c->sym = sym;
+	}
+	return sym;
+}
+
+static void addStack(struct ssymbol** syms, int depth) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < depth; i++) hash = (hash ^ hashptr(syms[i])) * 16777619u;
+
+	uint32_t i = hash & (STACKSLEN-1);
+	for (int n = 0; n < 64; n++, i = (i + 1) & (STACKSLEN-1)) {
+		struct sstack* s = S.stacks + i;
+		if (!s->depth) {
+			s->hash  = hash;
+			s->depth = depth;
+			memcpy(s->syms, syms, depth * sizeof(struct ssymbol*));
+			s->count = 1;
+			return;
+		}
+		if (s->hash == hash && s->depth == depth &&
+				!memcmp(s->syms, syms, depth * sizeof(struct ssymbol*))) {
+			s->count++;
+			return;
+		}
+	}
+	// table is too full, this stack is only counted per symbol
+}
+
+static void aggregate(struct sslot* s) {
+	struct ssymbol* syms[STACK_DEPTH];
+	int depth = 0;
+
+	S.total++;
+	for (int i = STACK_SKIP; i < s->depth; i++) {
+		struct ssymbol* sym = resolve(s->pc[i]);
+		if (!sym) continue;
+		if (!depth) sym->self++;
+		if (sym->stamp != S.total) { // recursion is counted once
+			sym->total++;
+			sym->stamp = S.total;
+		}
+		syms[depth++] = sym;
+	}
+	if (depth) addStack(syms, depth);
+}
+
+void processSampler() {
+	if (!S.syms) return;
+	for (int i = 0; i < SLOTS_LEN; i++) {
+		struct sslot* s = slots + i;
+		if (atomic_load_explicit(&s->state, memory_order_acquire) != SLOT_READY)
+			continue;
+		aggregate(s);
+		atomic_store_explicit(&s->state, SLOT_EMPTY, memory_order_release);
+	}
+}
+
+void resetSampler() {
+	if (!S.syms) return;
+	memset(S.syms, 0, sizeof(struct ssymbol) * SYMLEN);
+	memset(S.pcs, 0, sizeof(struct spc) * PCLEN);
+	memset(S.stacks, 0, sizeof(struct sstack) * STACKSLEN);
+	S.total = 0;
+	S.nsyms = 0;
+	atomic_store(&dropped, 0);
+}
+
+bool startSampler(int hz) {
+	if (S.running) return true;
+	if (hz <= 0 || hz > 10000) hz = SAMPLER_HZ;
+
+	if (!S.syms) {
+		S.syms   = calloc(SYMLEN, sizeof(struct ssymbol));
+		S.pcs    = calloc(PCLEN, sizeof(struct spc));
+		S.stacks = calloc(STACKSLEN, sizeof(struct sstack));
+		if (!S.syms || !S.pcs || !S.stacks) {
+			perror("NOMEM!");
+			free(S.syms); free(S.pcs); free(S.stacks);
+			S.syms = NULL; S.pcs = NULL; S.stacks = NULL;
+			return false;
+		}
+	}
+
+	// first backtrace() call loads libgcc and allocates memory, which is
+	// not allowed in the signal handler. Do it here
+	void* warm[4];
+	backtrace(warm, 4);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = handler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, NULL)) {
+		perror("sigaction(SIGPROF)");
+		return false;
+	}
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec  = 0;
+	timer.it_interval.tv_usec = 1000000 / hz;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL)) {
+		perror("setitimer(ITIMER_PROF)");
+		signal(SIGPROF, SIG_IGN);
+		return false;
+	}
+
+	S.running = true;
+	return true;
+}
+
+void stopSampler() {
+	if (!S.running) return;
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	signal(SIGPROF, SIG_IGN); // default action kills us, if one is pending
+	S.running = false;
+	processSampler(); // leftovers
+}
+
+bool samplerRunning() {
+	return S.running;
+}
+
+uint32_t samplerTotal() {
+	return S.total;
+}
+
+uint32_t samplerDropped() {
+	return atomic_load(&dropped);
+}
+
+int samplerTop(struct sampler_symbol* out, int max) {
+	if (!S.syms) return 0;
+	int n = 0;
+	for (int i = 0; i < SYMLEN; i++) {
+		struct ssymbol* s = S.syms + i;
+		if (!s->name || !s->total) continue;
+		struct sampler_symbol v = {s->name, s->self, s->total};
+
+		// insertion into sorted top
+		int j;
+		if (n < max) j = n++;
+		else if (max && out[max-1].self < v.self) j = max - 1;
+		else continue;
+		for (; j > 0 && out[j-1].self < v.self; j--) out[j] = out[j-1];
+		out[j] = v;
+	}
+	return n;
+}
+
+bool dumpSamplerFolded(const char* path) {
+	processSampler();
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		perror("can't open samples file");
+		return false;
+	}
+
+	for (int i = 0; S.stacks && i < STACKSLEN; i++) {
+		struct sstack* s = S.stacks + i;
+		if (!s->depth) continue;
+		for (int j = s->depth - 1; j >= 0; j--) // root first
+			fprintf(f, "%s%s", s->syms[j]->name, j ? ";" : "");
+		fprintf(f, " %u\n", s->count);
+	}
+
+	if (fclose(f)) {
+		perror("can't write samples file");
+		return false;
+	}
+	return true;
+}
+
+void initSampler() {
+	const char* path = getenv("PIXELBOX_SAMPLE");
+	if (path && *path) startSampler(SAMPLER_HZ);
+}
+
+void freeSampler() {
+	stopSampler();
+	const char* path = getenv("PIXELBOX_SAMPLE");
+	if (path && *path && dumpSamplerFolded(path))
+		printf("samples are written to %s\n", path);
+}
+
+#endif
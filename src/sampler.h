@@ -0,0 +1,70 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Statistical (sampling) profiler.
+ *
+ * SIGPROF timer interrupts the process every 1/hz of CPU time, and signal
+ * handler stores backtrace of the interrupted thread into the lock-free
+ * slot buffer. processSampler() (main thread, every frame) moves samples
+ * from there into per-symbol and per-stack tables. Symbols are resolved
+ * with dladdr(), that's why we are linked with -rdynamic :p
+ *
+ * Not available on windows : all functions are no-op there.
+ */
+
+#define SAMPLER_HZ 997 // not round, to not run in lockstep with frames
+
+bool startSampler(int hz);
+void stopSampler();
+bool samplerRunning();
+
+// drops all collected data
+void resetSampler();
+
+// aggregates new samples. Call it regulary, while sampler is running
+void processSampler();
+
+struct sampler_symbol {
+	const char* name;
+	uint32_t self;  // samples with this function on top of the stack
+	uint32_t total; // samples with this function anywhere in the stack
+};
+
+// copies up to max symbols with the biggest self count. Returns count
+int  samplerTop(struct sampler_symbol* out, int max);
+uint32_t samplerTotal(); // samples processed
+uint32_t samplerDropped(); // samples lost (buffer was full)
+
+/*
+ * Writes collected stacks in the "folded" format (one line per unique
+ * stack, "root;child;leaf count"), accepted by flamegraph.pl, inferno,
+ * speedscope and others. Returns false on error.
+ */
+bool dumpSamplerFolded(const char* path);
+
+/*
+ * PIXELBOX_SAMPLE=path/to/file.folded environment variable starts sampler
+ * in initSampler(), and freeSampler() writes stacks there.
+ */
+void initSampler();
+void freeSampler();
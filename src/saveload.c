@@ -17,6 +17,7 @@
  */
 
 #include "implix.h"
+#include "edit.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -178,6 +179,9 @@ int  loadChunk(struct chunk* c) {
 			const uint8_t* data = (uint8_t*)sqlite3_column_blob(stmt, 0);
 			if (data) {
 				memcpy(getChunkData(c, false), data, CHUNK_WIDTH*CHUNK_WIDTH);
+				// one more byte : wake up flag, see addSaveQueue()
+				if (sqlite3_column_bytes(stmt, 0) > CHUNK_WIDTH*CHUNK_WIDTH)
+					c->wake_on_load = data[CHUNK_WIDTH*CHUNK_WIDTH] != 0;
 				loaded = true;
 			}
 		}
@@ -195,7 +199,13 @@ sqlite3_stmt* stmt = create_statement(World.database,
 			return;
 		}
 		sqlite3_bind_int64(stmt, 1, c->pos.pack);
-		sqlite3_bind_blob(stmt, 2, getChunkData(c, MODE_READ), CHUNK_WIDTH*CHUNK_WIDTH, SQLITE_STATIC);
+		uint8_t buff[CHUNK_WIDTH*CHUNK_WIDTH + 1];
+		if (c->wake_on_load) { // older versions just ignore the last byte
+			memcpy(buff, getChunkData(c, MODE_READ), CHUNK_WIDTH*CHUNK_WIDTH);
+			buff[CHUNK_WIDTH*CHUNK_WIDTH] = 1;
+			sqlite3_bind_blob(stmt, 2, buff, sizeof(buff), SQLITE_STATIC);
+		} else
+			sqlite3_bind_blob(stmt, 2, getChunkData(c, MODE_READ), CHUNK_WIDTH*CHUNK_WIDTH, SQLITE_STATIC);
 		while (statement_iterator(stmt) > 0) {}
 		sqlite3_finalize(stmt);
 	}
@@ -289,6 +299,13 @@ int statement_iterator(sqlite3_stmt* stmt) {
 }
 
 
+// chunk was unloaded while it waited for an update (LOD), queue it again
+void wakeChunk(struct chunk* c) {
+	c->wake_on_load = 0;
+	c->is_changed = 1; // flag is cleared on disk with the next save
+	markWorldUpdate((int64_t)c->pos.axis[0] * CHUNK_WIDTH, (int64_t)c->pos.axis[1] * CHUNK_WIDTH);
+}
+
 bool saveloadTick() {
 	bool done_something = false;
 	struct chunkmap* m = &World.load;
@@ -310,7 +327,10 @@ bool saveloadTick() {
 			} else limit += SCORE_LOAD;
 
 			c->usagefactor = CHUNK_USAGE_VALUE;
+			touchChunk(c);
 			insertChunk(&World.map, c); // OK
+			if (c->wake_on_load) wakeChunk(c);
+			pasteArrived(c);
 		}
 		load_i++;
 	}
@@ -353,6 +373,8 @@ void addSaveQueue(struct chunk* c) {
 	if (findChunk(&World.save, c->pos.axis[0], c->pos.axis[1])) return;
 	if (findChunk(&World.update, 	c->pos.axis[0], c->pos.axis[1])) {
 		removeChunk(&World.update, c); // important
+		c->wake_on_load = 1; // not done yet, remember it
+		c->is_changed = 1;
 	}
 	insertChunk(&World.save, c);
 }
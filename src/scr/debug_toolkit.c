@@ -23,6 +23,7 @@
 #include <string.h>
 #include <assert.h>
 #include "profiler.h"
+#include "simulation.h"
 
 static Rectangle dwinrec = (Rectangle){
 	0, 100,
@@ -46,9 +47,15 @@ static const char* tabs[] = {
 	"rendering",
 	"allocator",
 	"control",
+	"counters",
+	"hitches",
+	"sampler",
+	"heat",
 	NULL
 };
 
+#define TABS_COUNT (int)(sizeof(tabs)/sizeof(*tabs) - 1)
+
 static int active_tab = 1;
 static int active_hash = 0;
 static int window_hidden = 1;
@@ -56,6 +63,8 @@ static int window_hidden = 1;
 void drawProfiler(Rectangle rec);
 void debugRender(Rectangle rec);
 void debugAllocator(Rectangle rec);
+void drawCounters(Rectangle rec);
+void drawHitches(Rectangle rec);
 
 #include "implix.h"
 
@@ -90,6 +99,7 @@ void debugHash(Rectangle rec) {
 	else if (active_hash == 2) m = &World.save;
 	else m = &World.update;
 
+	lockWorld();
 	for (int i = 0; i < MAPLEN; i++) {
 		struct chunk *o = m->data[i];
 		int j = 0;
@@ -102,13 +112,115 @@ void debugHash(Rectangle rec) {
 			j++;	
 		}
 	}
+	unlockWorld();
+}
+
+// hottest resident chunks, see heat overlay in render.c
+#define HEAT_TOP 16
+
+extern bool heat_overlay;
+
+struct heatitem {
+	union packpos pos;
+	uint32_t cost, changes;
+};
+
+static void debugHeat(Rectangle rec) {
+	Rectangle item = {rec.x, rec.y, 80, 15};
+	heat_overlay = GuiToggle(item, "Overlay", heat_overlay);
+
+	struct heatitem top[HEAT_TOP];
+	int n = 0;
+	uint64_t total = 0;
+
+	lockWorld();
+	for (int i = 0; i < MAPLEN; i++) {
+		for (struct chunk* c = World.map.data[i]; c; c = c->next) {
+			total += c->cost;
+			if (n == HEAT_TOP && c->cost <= top[n - 1].cost) continue;
+			int j = n < HEAT_TOP ? n++ : n - 1;
+			for (; j > 0 && top[j - 1].cost < c->cost; j--) top[j] = top[j - 1];
+			top[j] = (struct heatitem){c->pos, c->cost, c->changes};
+		}
+	}
+	unlockWorld();
+
+	// counters are halved every second, so they are ~2x of per second ones
+	DrawText(TextFormat("all chunks : %.2f ms/s", total / 2e6),
+		item.x + item.width + 10, item.y + 2, 10, GRAY);
+
+	int y = rec.y + 20;
+	for (int i = 0; i < n && top[i].cost && y + 10 < rec.y + rec.height; i++) {
+		Rectangle line = {rec.x, y, rec.width, 10};
+		bool hover = CheckCollisionPointRec(GetMousePosition(), line);
+		DrawText(TextFormat("%6i %6i  %8.1f us/s  %6u changes/s",
+			top[i].pos.axis[0], top[i].pos.axis[1], top[i].cost / 2e3, top[i].changes / 2),
+			rec.x, y, 10, hover ? YELLOW : WHITE);
+		if (hover && IsMouseButtonPressed(0)) { // go and see
+			cam.target.x = (top[i].pos.axis[0] + 0.5f) * CHUNK_WIDTH;
+			cam.target.y = (top[i].pos.axis[1] + 0.5f) * CHUNK_WIDTH;
+		}
+		y += 10;
+	}
 }
 
 static void controlTab(Rectangle rec) {
 	Rectangle item = (Rectangle){
 		rec.x, rec.y,
-		rec.width-25, 10
+		120, 15
+	};
+
+	bool trace = prof_trace_enabled();
+	if (GuiToggle(item, "Record trace", trace) != trace)
+		prof_trace_enable(!trace);
+
+	item.x += item.width + 5;
+	if (GuiButton(item, "Dump trace.json")) {
+		if (prof_trace_dump("trace.json"))
+			TraceLog(LOG_INFO, "trace is written to trace.json");
+	}
+}
+
+#include "sampler.h"
+
+static void debugSampler(Rectangle rec) {
+	Rectangle item = (Rectangle){
+		rec.x, rec.y,
+		80, 15
 	};
+
+	bool running = samplerRunning();
+	if (GuiToggle(item, "Sampling", running) != running) {
+		if (running) stopSampler();
+		else if (!startSampler(SAMPLER_HZ))
+			TraceLog(LOG_WARNING, "sampler is not available");
+	}
+
+	item.x += item.width + 5;
+	if (GuiButton(item, "Reset")) resetSampler();
+
+	item.x += item.width + 5;
+	item.width = 130;
+	if (GuiButton(item, "Dump samples.folded")) {
+		if (dumpSamplerFolded("samples.folded"))
+			TraceLog(LOG_INFO, "samples are written to samples.folded");
+	}
+
+	int y = rec.y + 20;
+	uint32_t total = samplerTotal();
+	DrawText(TextFormat("samples : %u, dropped : %u", total, samplerDropped()),
+		rec.x, y, 10, GRAY);
+	y += 12;
+
+	struct sampler_symbol top[16];
+	int n = samplerTop(top, 16);
+	if (!total) return;
+	for (int i = 0; i < n && y + 10 < rec.y + rec.height; i++) {
+		DrawText(TextFormat("%5.1f%% %5.1f%%  %s",
+			top[i].self * 100.0 / total, top[i].total * 100.0 / total, top[i].name),
+			rec.x, y, 10, WHITE);
+		y += 10;
+	}
 }
 
 #include "version.h"
@@ -149,7 +261,7 @@ void drawDToolkit() {
 
 	int old = rec.height;
 	rec.height = 20;
-	GuiTabBarEx(rec, 80, false, tabs, 5, &active_tab);
+	GuiTabBarEx(rec, 80, false, tabs, TABS_COUNT, &active_tab);
 	rec.y += 25;
 	rec.height = old - 25;
 	rec.x += 5;
@@ -171,6 +283,18 @@ void drawDToolkit() {
 		case 4:
 			controlTab(rec);
 		break;
+		case 5:
+			drawCounters(rec);
+		break;
+		case 6:
+			drawHitches(rec);
+		break;
+		case 7:
+			debugSampler(rec);
+		break;
+		case 8:
+			if (safeWorld()) debugHeat(rec);
+		break;
 		default :	
 		break;
 	}
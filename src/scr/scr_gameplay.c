@@ -23,6 +23,9 @@
 #include <string.h>
 #include <assert.h>
 #include "profiler.h"
+#include "simulation.h"
+#include "settings.h"
+#include <math.h>
 
 static int refcnt = 0;
 
@@ -46,18 +49,24 @@ static float ptime_old = 0;
 
 void initToolkit();
 void freeToolkit();
+void initMinimap();
+void freeMinimap();
+void processMinimap();
+bool updateMinimap(Camera2D* cam);
+void drawMinimap(Camera2D cam);
 
 static void create() {
 	WorldRefCreate();
 	initBuilder();
 	initToolkit();
+	initMinimap();
 	ptime_old = GetTime();
 
 	int64_t v;
 	prof_begin(PROF_DISK); 
 	if (loadProperty("zoom", &v)) {
 		cam.zoom = v / 7000.0;
-		if (cam.zoom < 0.5) cam.zoom = 0.5;
+		if (cam.zoom < minZoom()) cam.zoom = minZoom();
 		if (cam.zoom > 50) cam.zoom = 50;
 	} else cam.zoom = 3;
 
@@ -67,10 +76,15 @@ static void create() {
 	} else cam.target = (Vector2){120/2, 120/2};
 	cam.offset = (Vector2){GetScreenWidth()/2, GetScreenHeight()/2};
 	prof_end();
+
+	setWorldLod(conf_sim_near, conf_sim_far, conf_sim_rate);
+	initSimulation(GetTime); // world ticks on it's own from now
 }
 
 static void destroy() {
 	int64_t v;
+	freeSimulation(); // before anything touches the world or db
+	clearWorldView();
 
 	v = cam.zoom * 7000;
 	saveProperty("zoom", v);
@@ -83,12 +97,16 @@ static void destroy() {
 
 	freeBuilder();
 	freeToolkit();
+	freeMinimap();
 	WorldRefDestroy();
 }
 
 Camera2D cam = {0};
 
-void setline (int x0, int y0, int x1, int y1);
+void toolPress(int64_t x, int64_t y);
+void toolDrag(int64_t x, int64_t y);
+void toolRelease(int64_t x, int64_t y);
+void drawToolPreview(int64_t x, int64_t y);
 bool updateToolkit();
 void drawToolkit();
 
@@ -105,13 +123,15 @@ static void draw() {
 	prof_end();
 
 	Vector2 mousepos = GetScreenToWorld2D(GetMousePosition(), cam);
+	drawToolPreview(floorf(mousepos.x), floorf(mousepos.y));
 
 	EndMode2D();
+	drawMinimap(cam);
 	drawToolkit();
 }
 
 static void update() { 
-	if (!GuiIsLocked() && !updateToolkit()) { // interact
+	if (!GuiIsLocked() && !updateToolkit() && !updateMinimap(&cam)) { // interact
 		if (IsMouseButtonDown(0)) {
 			Vector2 md = GetMouseDelta();
 			cam.target.x -= md.x /cam.zoom;
@@ -120,15 +140,10 @@ static void update() {
 
 
 		// input
-		if (IsMouseButtonDown(1)) {
-			Vector2 dpos = GetMouseDelta();
-			Vector2 cpos = GetMousePosition();
-			dpos.x = cpos.x - dpos.x;
-			dpos.y = cpos.y - dpos.y;
-			dpos = GetScreenToWorld2D(dpos, cam); 
-			cpos = GetScreenToWorld2D(cpos, cam); 
-			setline(cpos.x, cpos.y, dpos.x, dpos.y);
-		}
+		Vector2 mpos = GetScreenToWorld2D(GetMousePosition(), cam);
+		int64_t mx = floorf(mpos.x), my = floorf(mpos.y);
+		if (IsMouseButtonPressed(1)) toolPress(mx, my);
+		else if (IsMouseButtonDown(1)) toolDrag(mx, my);
 
 		if (IsKeyDown(KEY_R)) {
 			cam.target = (Vector2){0, 0};
@@ -155,26 +170,33 @@ static void update() {
 
 		cam.zoom += GetMouseWheelMove() * 0.15 * cam.zoom;
 
-		if (cam.zoom < 0.5) cam.zoom = 0.5;
+		if (cam.zoom < minZoom()) cam.zoom = minZoom();
 		if (cam.zoom > 50) cam.zoom = 50;
 	}
 
-	prof_begin(PROF_UPDATE);
-	updateWorld();
-	prof_end(PROF_UPDATE);
+	if (IsMouseButtonReleased(1)) { // even over the toolkit, ends the shape
+		Vector2 mpos = GetScreenToWorld2D(GetMousePosition(), cam);
+		toolRelease(floorf(mpos.x), floorf(mpos.y));
+	}
 
-	prof_begin(PROF_LOAD_SAVE);
-	saveloadTick(); // done in
-	prof_end();
+	// update, load/save and GC are done by the simulation thread
+	// chunks of the view, for the simulation LOD rings
+	Vector2 a = GetScreenToWorld2D((Vector2){0, 0}, cam);
+	Vector2 b = GetScreenToWorld2D((Vector2){GetScreenWidth(), GetScreenHeight()}, cam);
+
+	lockWorld();
+	setWorldView(floorf(a.x / CHUNK_WIDTH), floorf(a.y / CHUNK_WIDTH),
+		floorf(b.x / CHUNK_WIDTH), floorf(b.y / CHUNK_WIDTH));
 
-	prof_begin(PROF_GC);
-	collectGarbage(); // important
+	PROF_BEGIN_ZONE("minimap");
+	processMinimap();
 	prof_end();
 
-	if (ptime_old + 1 < GetTime()) {
+	if (ptime_old + 1 < GetTime()) { // saved by the simulation thread
 		ptime_old = GetTime();
 		World.playtime += 1;
 	}
+	unlockWorld();
 }
 
 extern struct screen ScrSaveProc;
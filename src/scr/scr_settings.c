@@ -60,6 +60,25 @@ static void draw() {
 
 	item.y += 25;
 	conf_debug_mode = GuiToggle(item, "Debug Mode", conf_debug_mode);
+
+	item.y += 25;
+	conf_torus_render = GuiToggle(item, "Toroidal rendering", conf_torus_render);
+
+	item.y += 25;
+	conf_sim_near = GuiSliderBar(item, NULL,
+		TextFormat("Full rate simulation : +%i chunks", conf_sim_near),
+		conf_sim_near, 0, 64);
+
+	item.y += 25;
+	conf_sim_far = GuiSliderBar(item, NULL,
+		TextFormat("Slow simulation : +%i chunks", conf_sim_far),
+		conf_sim_far, 0, 256);
+	if (conf_sim_far < conf_sim_near) conf_sim_far = conf_sim_near;
+
+	item.y += 25;
+	conf_sim_rate = GuiSliderBar(item, NULL,
+		TextFormat("Slow simulation rate : 1/%i", conf_sim_rate),
+		conf_sim_rate, 1, 64);
 }
 
 static void update() {
@@ -22,7 +22,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 #include "profiler.h"
+#include "simulation.h"
+#include "edit.h"
 
 static int color_gradient = -1;
 static int color_material = -1;
@@ -40,8 +43,9 @@ static uint8_t b_rainbow() {
 	return rainbow_v;
 }
 
+// swatches only, painted cells get their own, see struct world_paint
 static uint8_t b_random() {
-	return randomNumber();
+	return GetRandomValue(0, 255);
 }
 
 static uint8_t b_noise() {
@@ -66,30 +70,134 @@ static uint8_t getcolor(int8_t m, int8_t g) {
 	return color;
 }
 
-void setline (int x0, int y0, int x1, int y1) {
-	int dx = ABS(x1 - x0);
-	int dy = ABS(y1 - y0) * -1;
-	int stepx = x0 < x1 ? 1 : -1;
-	int stepy = y0 < y1 ? 1 : -1;
-	
-	int err = dx + dy, e2 = 0;
-	int limit = 0;
-	
-	while (limit < 255) {
-		limit++;
-		setWorldPixel(x0, y0, 
-			getcolor(color_material, color_gradient), MODE_READ);
-		markWorldUpdate(x0, y0);
-		if (x0 == x1 && y0 == y1) break;
-		e2 = 2 * err;
-		if (e2 >= dy) {
-			err = err + dy;
-			x0  = x0 + stepx;
-		}
-		if (e2 <= dx) {
-			err = err + dx;
-			y0  = y0 + stepy;
-		}
+/*
+ * Tools. Everything is a shape, painted by the simulation thread.
+ * Coordinates are world pixels.
+ */
+
+enum {
+	TOOL_BRUSH,
+	TOOL_CIRCLE,
+	TOOL_RECT,
+	TOOL_FILL,
+	TOOL_COPY,  // corners, snapped to chunks
+	TOOL_PASTE  // top left corner
+};
+
+static int active_tool = TOOL_BRUSH;
+static float brush_size = 1; // radius, 0 is one pixel
+static bool tool_down = false;
+static int64_t tool_x, tool_y; // pressed at (or last brush position)
+static struct world_region* clipboard = NULL; // kept between worlds
+static bool paste_stamp = false; // air of the clipboard is not pasted
+static int copy_missing = 0; // chunks that were not loaded on copy
+
+static int8_t bnorm(int v);
+
+static struct world_paint getpaint() {
+	struct world_paint p;
+	p.v = getcolor(color_material, color_gradient);
+	p.random = (color_material == -1 ? 0xFC : 0) | (color_gradient == -1 ? 3 : 0);
+	return p;
+}
+
+static int toolRadius(int64_t x, int64_t y) {
+	double dx = x - tool_x, dy = y - tool_y;
+	return sqrt(dx * dx + dy * dy);
+}
+
+static void queueShape(int kind, int64_t x0, int64_t y0, int64_t x1, int64_t y1, int r) {
+	struct world_shape s = {kind, x0, y0, x1, y1, r, getpaint()};
+	queueWorldShape(&s);
+}
+
+static int64_t chunkFloor(int64_t v) {
+	return floor(v / (double)CHUNK_WIDTH);
+}
+
+static void toolCopy(int64_t x, int64_t y) {
+	lockWorld();
+	struct world_region* r = copyWorldRegion(chunkFloor(tool_x), chunkFloor(tool_y),
+		chunkFloor(x), chunkFloor(y), &copy_missing);
+	unlockWorld();
+	if (!r) return; // too big
+	freeWorldRegion(clipboard);
+	clipboard = r;
+}
+
+void freeClipboard() {
+	freeWorldRegion(clipboard);
+	clipboard = NULL;
+}
+
+void toolPress(int64_t x, int64_t y) {
+	tool_down = true;
+	tool_x = x;
+	tool_y = y;
+	switch (active_tool) {
+		case TOOL_BRUSH : queueShape(SHAPE_LINE, x, y, x, y, brush_size); break;
+		case TOOL_FILL : queueShape(SHAPE_FILL, x, y, x, y, 0); break;
+		case TOOL_PASTE :
+			if (clipboard) {
+				struct world_paste p = {clipboard, x, y, paste_stamp};
+				queueWorldPaste(&p);
+			}
+		break;
+		default : break;
+	}
+}
+
+void toolDrag(int64_t x, int64_t y) {
+	if (!tool_down || active_tool != TOOL_BRUSH) return;
+	if (x == tool_x && y == tool_y) return;
+	queueShape(SHAPE_LINE, tool_x, tool_y, x, y, brush_size);
+	tool_x = x;
+	tool_y = y;
+}
+
+void toolRelease(int64_t x, int64_t y) {
+	if (!tool_down) return;
+	tool_down = false;
+	switch (active_tool) {
+		case TOOL_CIRCLE : queueShape(SHAPE_CIRCLE, tool_x, tool_y, 0, 0, toolRadius(x, y)); break;
+		case TOOL_RECT : queueShape(SHAPE_RECT, tool_x, tool_y, x, y, 0); break;
+		case TOOL_COPY : toolCopy(x, y); break;
+		default : break;
+	}
+}
+
+// in world space (inside BeginMode2D)
+void drawToolPreview(int64_t x, int64_t y) {
+	Color c = getPixelColor(getcolor(bnorm(color_material), bnorm(color_gradient)));
+	c.a = 160;
+	switch (active_tool) {
+		case TOOL_BRUSH :
+			DrawCircleLines(x + 0.5, y + 0.5, brush_size + 0.5, c);
+		break;
+		case TOOL_CIRCLE :
+			if (tool_down) DrawCircleLines(tool_x + 0.5, tool_y + 0.5, toolRadius(x, y) + 0.5, c);
+			else DrawRectangle(x, y, 1, 1, c);
+		break;
+		case TOOL_RECT :
+			if (tool_down) DrawRectangleLines(x < tool_x ? x : tool_x, y < tool_y ? y : tool_y,
+				ABS(x - tool_x) + 1, ABS(y - tool_y) + 1, c);
+			else DrawRectangle(x, y, 1, 1, c);
+		break;
+		case TOOL_COPY : {
+			int64_t x0 = chunkFloor(tool_down ? tool_x : x), y0 = chunkFloor(tool_down ? tool_y : y);
+			int64_t x1 = chunkFloor(x), y1 = chunkFloor(y);
+			if (x0 > x1) {int64_t t = x0; x0 = x1; x1 = t;}
+			if (y0 > y1) {int64_t t = y0; y0 = y1; y1 = t;}
+			DrawRectangleLines(x0 * CHUNK_WIDTH, y0 * CHUNK_WIDTH,
+				(x1 - x0 + 1) * CHUNK_WIDTH, (y1 - y0 + 1) * CHUNK_WIDTH, YELLOW);
+		} break;
+		case TOOL_PASTE :
+			if (clipboard) DrawRectangleLines(x, y,
+				clipboard->w * CHUNK_WIDTH, clipboard->h * CHUNK_WIDTH, YELLOW);
+		break;
+		default :
+			DrawRectangle(x, y, 1, 1, c);
+		break;
 	}
 }
 
@@ -230,6 +338,11 @@ static void drawStats(Rectangle rec) {
 		(World.playtime/60)%60,
 		World.playtime%60)
 	);
+	item.y += item.height + 5;
+	const struct world_sched* sched = getWorldSched();
+	GuiLabel(item, TextFormat("Sim lag : %.1f ms, %i ticks/frame, %i dropped",
+		sched->lag * 1000.0, sched->ticks, (int)sched->dropped)
+	);
 }
 
 extern struct screen ScrSaveProc;
@@ -291,13 +404,21 @@ void drawToolkit() {
 
 	switch(active_tab) {
 		case 0 : {// world
+			// simulation thread reads these flags under the world lock
 			if (GuiToggle(item, "Enable Physic", allowupdate) != allowupdate) {
-				World.is_update_enabled = !allowupdate;
 				allowupdate = !allowupdate;
+				lockWorld();
+				World.is_update_enabled = allowupdate;
+				unlockWorld();
 			}
 			item.y += item.height + 5;
 
-			GuiButton(item, "Dummy");
+			bool water = GuiToggle(item, "Water leveling", World.water_solver);
+			if (water != World.water_solver) {
+				lockWorld();
+				World.water_solver = water;
+				unlockWorld();
+			}
 			item.y += item.height + 5;
 
 			GuiButton(item, "Dummy");
@@ -316,9 +437,28 @@ void drawToolkit() {
 		case 2 : {// stats
 			drawStats(rec);
 		}; break;
-		case 3 :
-
-		break;
+		case 3 : {// tools
+			item.width = (rec.width - 20) / 6; // per toggle
+			active_tool = GuiToggleGroup(item, "Brush;Circle;Rect;Fill;Copy;Paste", active_tool);
+			item.width = rec.width - 100;
+			item.y += item.height + 5;
+			brush_size = (int)GuiSliderBar(item, NULL,
+				TextFormat("Brush : %i", (int)brush_size), brush_size, 0, 64);
+			item.y += item.height + 5;
+			item.width = 80;
+			paste_stamp = GuiCheckBox((Rectangle){item.x, item.y, 20, 20}, "Stamp", paste_stamp);
+			item.x += item.width;
+			item.width = rec.width - 90;
+			if (clipboard) GuiLabel(item, TextFormat("%ix%i chunks, %i KB%s",
+				clipboard->w, clipboard->h, (int)(clipboard->size / 1024),
+				copy_missing ? " (partial)" : ""));
+			else GuiLabel(item, "Clipboard is empty");
+			int pastes, waiting, dropped;
+			pasteStats(&pastes, &waiting, &dropped);
+			item.y += item.height;
+			if (pastes || dropped) GuiLabel(item, TextFormat("Pasting : %i chunks wait (%i pastes), %i dropped",
+				waiting, pastes, dropped));
+		}; break;
 		default :
 			
 		break;
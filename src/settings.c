@@ -23,6 +23,10 @@ bool  conf_vsync   = true;
 int   conf_win_width = 640;
 int   conf_win_height = 480;
 bool  conf_debug_mode = 0;
+bool  conf_torus_render = 0;
+int   conf_sim_near = 4;
+int   conf_sim_far  = 16;
+int   conf_sim_rate = 4;
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -57,6 +61,14 @@ void reloadSettings() {
 	conf_win_height = LIMIT(conf_win_height, 100, INT_MAX);
 	conf_debug_mode = READ(conf_debug_mode, PIXELBOX_DEBUG);
 	conf_debug_mode = LIMIT((int)conf_debug_mode, 0, 1);
+	conf_torus_render = READ(conf_torus_render, 0);
+	conf_torus_render = LIMIT((int)conf_torus_render, 0, 1);
+	conf_sim_near = READ(conf_sim_near, 4);
+	conf_sim_near = LIMIT(conf_sim_near, 0, 64);
+	conf_sim_far = READ(conf_sim_far, 16);
+	conf_sim_far = LIMIT(conf_sim_far, conf_sim_near, 256);
+	conf_sim_rate = READ(conf_sim_rate, 4);
+	conf_sim_rate = LIMIT(conf_sim_rate, 1, 64);
 	if (F) fclose(F);
 }
 
@@ -68,5 +80,9 @@ void saveSattings() {
 	WRITE(conf_win_width);
 	WRITE(conf_win_height);
 	WRITE(conf_debug_mode);
+	WRITE(conf_torus_render);
+	WRITE(conf_sim_near);
+	WRITE(conf_sim_far);
+	WRITE(conf_sim_rate);
 	if (F) fclose(F);
 }
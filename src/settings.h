@@ -25,6 +25,10 @@ extern int   conf_max_fps;
 extern int   conf_win_width;
 extern int   conf_win_height;
 extern bool  conf_debug_mode;
+extern bool  conf_torus_render;
+extern int   conf_sim_near; // simulation LOD rings, in chunks from the view
+extern int   conf_sim_far;
+extern int   conf_sim_rate; // far ring ticks once per rate ticks
 
 void reloadSettings();
 void saveSattings();
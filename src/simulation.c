@@ -0,0 +1,172 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "implix.h"
+#include "simulation.h"
+#include "edit.h"
+#include "profiler.h"
+#include <stdio.h>
+#include <stdatomic.h>
+#include "libs/c89threads.h"
+
+#define SHAPES_MAX 256 // per step, the rest is dropped
+#define PASTES_MAX 16 // per step, the rest is dropped
+
+static struct {
+	c89thrd_t thread;
+	c89mtx_t  world; // World.* and everything chunks touch
+	c89mtx_t  edits; // pending queue only
+	struct world_shape shapes[2][SHAPES_MAX]; // pending and applied, swapped every step
+	int shapes_len, shapes_pending; // of the pending one, and it's index
+	struct world_paste pastes[2][PASTES_MAX]; // same
+	int pastes_len, pastes_pending;
+	double (*clock)(void);
+	atomic_bool running;
+	bool inited;
+} Sim;
+
+void lockWorld() {
+	if (Sim.inited) c89mtx_lock(&Sim.world);
+}
+
+void unlockWorld() {
+	if (Sim.inited) c89mtx_unlock(&Sim.world);
+}
+
+bool simulationRunning() {
+	return atomic_load(&Sim.running);
+}
+
+void queueWorldShape(const struct world_shape* s) {
+	if (!Sim.inited) {
+		paintWorldShape(s);
+		return;
+	}
+	c89mtx_lock(&Sim.edits);
+	if (Sim.shapes_len < SHAPES_MAX)
+		Sim.shapes[Sim.shapes_pending][Sim.shapes_len++] = *s;
+	c89mtx_unlock(&Sim.edits);
+}
+
+void queueWorldPaste(const struct world_paste* p) {
+	if (!Sim.inited) {
+		pasteWorldRegion(p);
+		return;
+	}
+	c89mtx_lock(&Sim.edits);
+	if (Sim.pastes_len < PASTES_MAX) {
+		struct world_paste* q = Sim.pastes[Sim.pastes_pending] + Sim.pastes_len++;
+		*q = *p;
+		keepWorldRegion(q->region);
+	}
+	c89mtx_unlock(&Sim.edits);
+}
+
+// world lock must be held
+static void applyEdits() {
+	c89mtx_lock(&Sim.edits);
+	struct world_shape* shapes = Sim.shapes[Sim.shapes_pending];
+	int shapes_len = Sim.shapes_len;
+	Sim.shapes_pending = !Sim.shapes_pending;
+	Sim.shapes_len = 0;
+	struct world_paste* pastes = Sim.pastes[Sim.pastes_pending];
+	int pastes_len = Sim.pastes_len;
+	Sim.pastes_pending = !Sim.pastes_pending;
+	Sim.pastes_len = 0;
+	c89mtx_unlock(&Sim.edits);
+
+	for (int i = 0; i < shapes_len; i++) paintWorldShape(shapes + i);
+	for (int i = 0; i < pastes_len; i++) {
+		pasteWorldRegion(pastes + i);
+		freeWorldRegion(pastes[i].region);
+	}
+	PROF_COUNT("edits", shapes_len + pastes_len);
+}
+
+static int simMain(void* unused) {
+	(void)unused;
+	prof_register_thread();
+	const double step = 1.0 / WORLD_TPS;
+
+	while (atomic_load(&Sim.running)) {
+		double start = Sim.clock();
+
+		c89mtx_lock(&Sim.world);
+		applyEdits();
+
+		prof_begin(PROF_UPDATE);
+		updateWorld();
+		prof_end();
+
+		prof_begin(PROF_LOAD_SAVE);
+		saveloadTick();
+		prof_end();
+
+		prof_begin(PROF_GC);
+		collectGarbage();
+		prof_end();
+		c89mtx_unlock(&Sim.world);
+
+		prof_step();
+
+		// wait for the next tick. Scheduler in updateWorld() does the rest
+		double left = step - (Sim.clock() - start);
+		if (left > 0.0005)
+			c89thrd_sleep_timespec(c89timespec_nanoseconds(left * 1e9));
+		else c89thrd_yield(); // let render thread take the lock
+	}
+
+	prof_unregister_thread();
+	return 0;
+}
+
+bool initSimulation(double (*clock)(void)) {
+	if (Sim.inited) return true;
+	if (c89mtx_init(&Sim.world, c89mtx_plain) != c89thrd_success ||
+			c89mtx_init(&Sim.edits, c89mtx_plain) != c89thrd_success) {
+		perror("can't create simulation mutexes!");
+		return false;
+	}
+	Sim.clock = clock;
+	setWorldClock(clock);
+	Sim.inited = true;
+	atomic_store(&Sim.running, true);
+
+	if (c89thrd_create(&Sim.thread, simMain, NULL) != c89thrd_success) {
+		perror("can't create simulation thread!");
+		atomic_store(&Sim.running, false);
+		freeSimulation();
+		return false;
+	}
+	return true;
+}
+
+void freeSimulation() {
+	if (!Sim.inited) return;
+	if (atomic_load(&Sim.running)) {
+		atomic_store(&Sim.running, false);
+		c89thrd_join(Sim.thread, NULL);
+	}
+	c89mtx_destroy(&Sim.world);
+	c89mtx_destroy(&Sim.edits);
+	Sim.shapes_len = 0;
+	for (int i = 0; i < Sim.pastes_len; i++) // never applied
+		freeWorldRegion(Sim.pastes[Sim.pastes_pending][i].region);
+	Sim.pastes_len = 0;
+	Sim.inited = false;
+}
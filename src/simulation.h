@@ -0,0 +1,55 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Simulation thread.
+ *
+ * World ticks, load/save and GC run on their own thread at WORLD_TPS,
+ * so simulation and frame rate don't fight each other anymore. Every
+ * simulation step is done with the world lock held. Render thread takes
+ * the lock only while it gathers chunk data into it's CPU side atlases,
+ * and those are the consistent snapshot it draws and uploads from.
+ *
+ * Edits are never done by the render thread directly : they are queued
+ * and applied by the simulation thread before the next tick.
+ */
+
+// world must be opened. Sets the world clock!
+bool initSimulation(double (*clock)(void));
+void freeSimulation(); // waits for the current step, then stops
+
+bool simulationRunning();
+
+// everything that reads or writes World.* maps from the render thread
+void lockWorld();
+void unlockWorld();
+
+struct world_shape;
+
+// paints the shape (and wakes it up) on the simulation thread, before
+// next tick. See edit.h
+void queueWorldShape(const struct world_shape* s);
+
+struct world_paste;
+
+// same for a region paste. Queue keeps it's own reference to the region
+void queueWorldPaste(const struct world_paste* p);
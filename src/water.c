@@ -0,0 +1,304 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "implix.h"
+#include "water.h"
+#include "profiler.h"
+#include "materials-generated.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BODY_MIN   64        // smaller bodies are left to the cellular stuff
+#define BODY_MAX   (1 << 16) // cells per body, the rest is left for later
+#define MOVES_MAX  4096      // per solve
+#define CHUNKS_LEN 4096      // chunks touched per solve, must be pow of 2!
+
+#define IS_AIR(V)   (mat_flags[V] & MAT_EMPTY)
+#define IS_WATER(V) (mat_flags[V] & MAT_FLOW) // anything that flows
+
+struct wcell {
+	int64_t x, y;
+};
+
+// chunk, as seen by the solver. Nothing is unloaded during the solve
+struct wchunk {
+	uint32_t pack;
+	uint32_t gen; // of the solve, entry is empty if it's not current
+	struct chunk* c; // NULL if we can't touch it (wall)
+	uint8_t seen[CHUNK_WIDTH*CHUNK_WIDTH/8];
+};
+
+// binary heap of cells by y. Top is the highest (min y) or the lowest
+struct wheap {
+	struct wcell* v;
+	int len, cap;
+	bool lowest;
+};
+
+static struct {
+	struct wheap top, bottom; // water of the body, air around it
+	struct wcell* queue; // BFS
+	int queuecap;
+	struct wchunk* chunks; // open addressing
+	struct wchunk* last;
+	int nchunks;
+	uint32_t gen;
+	struct chunk** seeds;
+	int seedcap;
+	uint64_t next; // tick of the next solve
+	int period;
+} Water = {.bottom = {.lowest = true}};
+
+void freeWater(void) {
+	free(Water.top.v);
+	free(Water.bottom.v);
+	free(Water.queue);
+	free(Water.chunks);
+	free(Water.seeds);
+	memset(&Water, 0, sizeof(Water));
+	Water.bottom.lowest = true;
+}
+
+static bool grow(void** p, int* cap, int need, size_t size) {
+	if (need <= *cap) return true;
+	int n = *cap ? *cap : 256;
+	while (n < need) n *= 2;
+	void* r = realloc(*p, n * size);
+	if (!r) {
+		perror("NOMEM!");
+		return false;
+	}
+	*p = r;
+	*cap = n;
+	return true;
+}
+
+static inline bool above(const struct wheap* h, struct wcell a, struct wcell b) {
+	return h->lowest ? a.y > b.y : a.y < b.y;
+}
+
+static bool heapPush(struct wheap* h, struct wcell c) {
+	if (!grow((void**)&h->v, &h->cap, h->len + 1, sizeof(struct wcell)))
+		return false;
+	int i = h->len++;
+	while (i > 0) {
+		int p = (i - 1) / 2;
+		if (!above(h, c, h->v[p])) break;
+		h->v[i] = h->v[p];
+		i = p;
+	}
+	h->v[i] = c;
+	return true;
+}
+
+static struct wcell heapPop(struct wheap* h) {
+	struct wcell res = h->v[0], last = h->v[--h->len];
+	int i = 0;
+	for (;;) {
+		int l = i * 2 + 1, r = l + 1, m = i;
+		struct wcell best = last;
+		if (l < h->len && above(h, h->v[l], best)) {m = l; best = h->v[l];}
+		if (r < h->len && above(h, h->v[r], best)) {m = r;}
+		if (m == i) break;
+		h->v[i] = h->v[m];
+		i = m;
+	}
+	if (h->len) h->v[i] = last;
+	return res;
+}
+
+static struct wchunk wall = {0}; // when the table is full. Never seen
+
+static struct wchunk* chunkAt(int64_t x, int64_t y) {
+	union packpos pos;
+	pos.axis[0] = (uint64_t)x/CHUNK_WIDTH;
+	pos.axis[1] = (uint64_t)y/CHUNK_WIDTH;
+	if (Water.last && Water.last->pack == pos.pack) return Water.last;
+
+	uint32_t i = hash_function(pos.pack) & (CHUNKS_LEN - 1);
+	struct wchunk* e = Water.chunks + i;
+	while (e->gen == Water.gen) {
+		if (e->pack == pos.pack) return Water.last = e;
+		i = (i + 1) & (CHUNKS_LEN - 1);
+		e = Water.chunks + i;
+	}
+
+	if (Water.nchunks >= CHUNKS_LEN/2) // table is full, everything new is a wall
+		return &wall;
+
+	e->pack = pos.pack;
+	e->gen  = Water.gen;
+	e->c    = NULL;
+	memset(e->seen, 0, sizeof(e->seen));
+	if (chunkLodRing(pos.axis[0], pos.axis[1]) == 0)
+		e->c = findChunk(&World.map, pos.axis[0], pos.axis[1]);
+	Water.nchunks++;
+	return Water.last = e;
+}
+
+static inline int cellIndex(int64_t x, int64_t y) {
+	return (uint64_t)x%CHUNK_WIDTH + (uint64_t)y%CHUNK_WIDTH * CHUNK_WIDTH;
+}
+
+// NULL if chunk is not resident or not in the nearest LOD ring
+static uint8_t* cellAt(int64_t x, int64_t y, struct chunk** out) {
+	struct wchunk* e = chunkAt(x, y);
+	if (!e->c) return NULL;
+	if (out) *out = e->c;
+	return getChunkData(e->c, MODE_READ) + cellIndex(x, y);
+}
+
+// true, if cell was not seen in this solve yet (and marks it)
+static bool see(int64_t x, int64_t y) {
+	struct wchunk* e = chunkAt(x, y);
+	if (e == &wall) return false; // shared, so we don't mark it. Next solve
+	int i = cellIndex(x, y);
+	if (e->seen[i >> 3] & (1 << (i & 7))) return false;
+	e->seen[i >> 3] |= 1 << (i & 7);
+	return true;
+}
+
+static void changed(struct chunk* c, int64_t x, int64_t y) {
+	c->is_changed = 1;
+	c->changes++;
+	touchChunk(c);
+	markWorldUpdate(x, y); // let cellular stuff check it out
+}
+
+static const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+static void pushAir(int64_t x, int64_t y) {
+	for (int d = 0; d < 4; d++) {
+		int64_t nx = x + dirs[d][0], ny = y + dirs[d][1];
+		uint8_t* p = cellAt(nx, ny, NULL);
+		if (p && IS_AIR(*p)) heapPush(&Water.bottom, (struct wcell){nx, ny});
+	}
+}
+
+// flood fill of the body. Fills both heaps. Returns body size
+static int collectBody(int64_t x, int64_t y) {
+	int len = 0, head = 0;
+	Water.top.len = Water.bottom.len = 0;
+	Water.queue[len++] = (struct wcell){x, y};
+
+	while (head < len) {
+		struct wcell c = Water.queue[head++];
+		uint8_t* up = cellAt(c.x, c.y - 1, NULL);
+		if (!up || !IS_WATER(*up)) heapPush(&Water.top, c); // surface only
+		for (int d = 0; d < 4; d++) {
+			int64_t nx = c.x + dirs[d][0], ny = c.y + dirs[d][1];
+			uint8_t* p = cellAt(nx, ny, NULL);
+			if (!p) continue; // wall for us
+			if (IS_AIR(*p)) {
+				heapPush(&Water.bottom, (struct wcell){nx, ny});
+			} else if (IS_WATER(*p) && len < BODY_MAX && see(nx, ny)) {
+				Water.queue[len++] = (struct wcell){nx, ny};
+			}
+		}
+	}
+	return len;
+}
+
+// moves water from the top of the body into the lowest air around
+static int levelBody(int budget) {
+	int moves = 0;
+	while (moves < budget && Water.top.len && Water.bottom.len) {
+		struct wcell w = Water.top.v[0], a = Water.bottom.v[0];
+		struct chunk *wc = NULL, *ac = NULL;
+		uint8_t* wp = cellAt(w.x, w.y, &wc);
+		uint8_t* ap = cellAt(a.x, a.y, &ac);
+		if (!wp || !IS_WATER(*wp)) {heapPop(&Water.top); continue;} // stale
+		if (!ap || !IS_AIR(*ap)) {heapPop(&Water.bottom); continue;}
+		if (a.y <= w.y) break; // level :)
+
+		heapPop(&Water.top);
+		heapPop(&Water.bottom);
+		*ap = *wp;
+		*wp = 0;
+		changed(wc, w.x, w.y);
+		changed(ac, a.x, a.y);
+
+		// water under the moved cell is the surface now
+		uint8_t* down = cellAt(w.x, w.y + 1, NULL);
+		if (down && IS_WATER(*down)) heapPush(&Water.top, (struct wcell){w.x, w.y + 1});
+		uint8_t* up = cellAt(a.x, a.y - 1, NULL);
+		if (!up || !IS_WATER(*up)) heapPush(&Water.top, a);
+		pushAir(a.x, a.y);
+		moves++;
+	}
+	return moves;
+}
+
+int solveWater(void) {
+	if (!Water.chunks) {
+		Water.chunks = calloc(CHUNKS_LEN, sizeof(struct wchunk));
+		if (!Water.chunks) {
+			perror("NOMEM!");
+			freeWater();
+			return 0;
+		}
+	}
+	if (!grow((void**)&Water.queue, &Water.queuecap, BODY_MAX, sizeof(struct wcell)))
+		return 0;
+	if (++Water.gen == 0) { // wrapped, forget everything
+		memset(Water.chunks, 0, CHUNKS_LEN * sizeof(struct wchunk));
+		Water.gen = 1;
+	}
+	Water.last = NULL;
+	Water.nchunks = 0;
+
+	// seeds first, we will add chunks to the update queue later
+	int nseeds = 0;
+	for (int i = 0; i < MAPLEN; i++) {
+		for (struct chunk* c = World.update.data[i]; c; c = c->next2) {
+			if (chunkLodRing(c->pos.axis[0], c->pos.axis[1]) != 0) continue;
+			if (!grow((void**)&Water.seeds, &Water.seedcap, nseeds + 1, sizeof(struct chunk*)))
+				return 0;
+			Water.seeds[nseeds++] = c;
+		}
+	}
+
+	int moves = 0, bodies = 0;
+	for (int i = 0; i < nseeds && moves < MOVES_MAX; i++) {
+		struct chunk* c = Water.seeds[i];
+		const uint8_t* data = getChunkData(c, MODE_READ);
+		for (int j = 0; j < CHUNK_WIDTH*CHUNK_WIDTH && moves < MOVES_MAX; j++) {
+			if (!IS_WATER(data[j])) continue;
+			int64_t x = (int64_t)c->pos.axis[0] * CHUNK_WIDTH + j % CHUNK_WIDTH;
+			int64_t y = (int64_t)c->pos.axis[1] * CHUNK_WIDTH + j / CHUNK_WIDTH;
+			if (!see(x, y)) continue;
+			if (collectBody(x, y) < BODY_MIN) continue;
+			moves += levelBody(MOVES_MAX - moves);
+			bodies++;
+		}
+	}
+
+	PROF_COUNT("water moves", moves);
+	PROF_COUNT("water bodies", bodies);
+	return moves;
+}
+
+int tickWater(void) {
+	if (World.tick < Water.next && Water.next - World.tick <= WATER_PERIOD_MAX)
+		return 0; // (second check is for a new world, with tick from zero)
+	int moves = solveWater();
+	if (moves || Water.period < WATER_PERIOD) Water.period = WATER_PERIOD;
+	else if (Water.period < WATER_PERIOD_MAX) Water.period *= 2;
+	Water.next = World.tick + Water.period;
+	return moves;
+}
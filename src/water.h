@@ -0,0 +1,44 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Water leveling solver (optional, World.water_solver).
+ *
+ * Cellular water moves one cell sideways per stage, so a big reservoir
+ * takes ages to flatten, and keeps all it's chunks in the update queue.
+ * Every WATER_PERIOD ticks this finds connected water bodies, starting
+ * from the queued chunks, and moves water from the top of the body right
+ * into the lowest air cells touching it, until the surface is level.
+ * Cellular simulation does the rest (and puts settled chunks to sleep).
+ * While there is nothing to level, period grows up to WATER_PERIOD_MAX,
+ * since flat surface still wiggles and keeps it's chunks queued.
+ *
+ * Only resident chunks of the nearest LOD ring are touched. Nothing is
+ * loaded, unloaded or generated here.
+ */
+
+#define WATER_PERIOD 8 // ticks between solves
+#define WATER_PERIOD_MAX 256
+
+int  solveWater(void); // right now. Returns count of moved cells
+int  tickWater(void);  // every tick, solves when it's time
+void freeWater(void);  // drops solver buffers
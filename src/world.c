@@ -17,6 +17,8 @@
  */
 
 #include "implix.h"
+#include "water.h"
+#include "edit.h"
 struct worldState World;
 
 #include "sqlite3.h"
@@ -26,6 +28,7 @@ struct worldState World;
 
 int initWorld(void) {
 	World.database = NULL;
+	World.tick = 0;
 	setWorldSeed(time(NULL));
 	memset(&World.map, 0, sizeof(World.map));
 	memset(&World.load, 0, sizeof(World.load));
@@ -44,6 +47,7 @@ void flushWorld (void) {
 	saveProperty("seed", World.seed);
 	saveProperty("mode", World.mode);
 	saveProperty("playtime", World.playtime);
+	saveProperty("tick", World.tick);
 
 	// heheboi
 	for (int i = 0; i < MAPLEN; i++) {
@@ -68,6 +72,8 @@ void freeWorld(void) {
 	collectAnything(); // cleans up World.map to World.save
 	flushWorld(); // flushChunks() is not called there, btw
 	freeSaveLoad();
+	freeWater();
+	dropPendingPastes();
 }
 
 
@@ -79,6 +85,7 @@ int  openWorld(const char* path) {
 	if (loadProperty("seed", &v)) setWorldSeed(v);
 	if (loadProperty("mode", &v)) World.mode = v;
 	if (loadProperty("playtime", &v)) World.playtime = v;
+	if (loadProperty("tick", &v)) World.tick = v;
 	return 0;
 }
 
@@ -91,6 +98,7 @@ void setWorldPixel(int64_t x, int64_t y, uint8_t val, bool mode) {
 	int ax = (uint64_t)x%CHUNK_WIDTH;
 	int ay = (uint64_t)y%CHUNK_WIDTH;
 	ch->is_changed = 1; // yeah...
+	touchChunk(ch);
 	getChunkData(ch, mode)[ax + ay * CHUNK_WIDTH] = val;	
 }
 
@@ -161,6 +169,7 @@ static struct chunk* slow_loading_path(int16_t x, int16_t y) {
 		c->usagefactor = CHUNK_USAGE_VALUE;
 		removeChunk(&World.save, c); // important!
 		insertChunk(&World.map, c); 
+		if (c->wake_on_load) wakeChunk(c);
 		return c;
 	}
 
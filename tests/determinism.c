@@ -0,0 +1,449 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "implix.h"
+#include "headless.h"
+#include "profiler.h"
+#include "units.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/*
+ * Determinism harness.
+ *
+ * Runs seeded scenarios for a fixed amount of ticks, and hashes the
+ * whole resident world after every tick. Hashes are compared with the
+ * golden ones, checked into the repo, so any change of the simulation
+ * behaviour is caught. Update golden hashes ONLY when behaviour is
+ * changed on purpose!
+ *
+ *   pixelbox-check golden.txt              compare with golden hashes
+ *   pixelbox-check --update golden.txt     rewrite golden hashes
+ *   pixelbox-check --diff ENGINE ENGINE    compare two engines chunk by chunk
+ *   pixelbox-check --compare ENGINE ENGINE compare mass and mean height
+ *
+ * Every engine has it's own golden hashes ("engine/scenario", pull is
+ * just "scenario"). Engines are not expected to match each other hash
+ * by hash, but an engine must keep mass of every material, and stay
+ * within HEIGHT_TOLERANCE of pull (see --compare, it is a part of the
+ * check too). Unit checks (see units.h) are run at the end.
+ *
+ * Note : worldgen uses floating point noise, so golden hashes may differ
+ * between platforms/compilers. They are made on x86_64 linux with gcc.
+ */
+
+#define TICKS 256
+#define SEED  1337
+#define MAX_DIFFS 16
+#define HEIGHT_TOLERANCE 8.0 // pixels, mean height of a material
+
+struct scenario {
+	const char* name;
+	int mode;
+	struct headless_view view;
+	void (*setup)(void);
+	void (*tick)(int i); // before every tick, may be NULL
+	bool (*valid)(void); // world at the end, may be NULL
+};
+
+static void sandPile(void) {
+	headlessFill(-40, -80, 40, 50, 1 << 2);
+}
+
+static void waterBlock(void) {
+	headlessFill(-64, -60, 64, 40, 2 << 2);
+}
+
+static void mixed(void) { // water falls onto sand
+	headlessFill(-48, 0, 48, 40, 1 << 2);
+	headlessFill(-32, -60, 32, -20, 2 << 2);
+}
+
+static void terrain(void) { // sand rain over generated terrain
+	for (int64_t x = -96; x < 96; x += 3) headlessFill(x, -100, x + 1, -40, 1 << 2);
+}
+
+/*
+ * LOD view goes away and back, like the camera does. Sand hangs in the
+ * air of a frozen chunk, it is unloaded while it waits, and must fall
+ * when the view is back. Renderer keeps it's view loaded, so do we.
+ */
+
+#define AWAY_X 30 // chunks
+
+static void loadRect(int x0, int y0, int x1, int y1) {
+	for (int i = 0; i < 100000; i++) {
+		bool ready = true;
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				if (getWorldChunk(x, y) == &empty) ready = false;
+		if (ready) return;
+		saveloadTick();
+	}
+}
+
+static void away(void) {
+	setWorldLod(1, 2, 4);
+	setWorldView(-6, -6, 6, 4);
+	loadRect(AWAY_X, 0, AWAY_X, 0);
+	headlessFill(AWAY_X * CHUNK_WIDTH, 0, AWAY_X * CHUNK_WIDTH + CHUNK_WIDTH, 8, 1 << 2);
+}
+
+static void awayTick(int i) {
+	if (i < TICKS / 2) return; // long enough to be collected
+	setWorldView(AWAY_X - 6, -6, AWAY_X + 6, 4);
+	for (int y = -6; y <= 4; y++)
+		for (int x = AWAY_X - 6; x <= AWAY_X + 6; x++) getWorldChunk(x, y);
+}
+
+static bool awayValid(void); // see below
+
+// mode 1 is the flat world, see headlessFill()
+static const struct scenario scenarios[] = {
+	{"sand_pile",   1, {-6, -6, 6, 4}, sandPile, NULL, NULL},
+	{"water_block", 1, {-6, -6, 6, 4}, waterBlock, NULL, NULL},
+	{"mixed",       1, {-6, -6, 6, 4}, mixed, NULL, NULL},
+	{"terrain",     0, {-7, -7, 7, 7}, terrain, NULL, NULL},
+	{"lod_return",  1, {-6, -6, 6, 4}, away, awayTick, awayValid},
+	{NULL, 0, {0}, NULL, NULL, NULL}
+};
+
+#define FNV_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static uint64_t fnv(uint64_t h, const uint8_t* data, size_t len) {
+	for (size_t i = 0; i < len; i++) h = (h ^ data[i]) * FNV_PRIME;
+	return h;
+}
+
+static uint64_t chunkHash(struct chunk* c) {
+	uint64_t h = fnv(FNV_BASIS, (const uint8_t*)&c->pos.pack, sizeof(c->pos.pack));
+	return fnv(h, getChunkData(c, MODE_READ), CHUNK_WIDTH*CHUNK_WIDTH);
+}
+
+// chunk states of one tick, sorted by position
+struct cstate {
+	uint32_t pos;
+	uint64_t hash;
+};
+
+struct snapshot {
+	struct cstate* chunks;
+	int count;
+	uint64_t hash; // of the whole world
+};
+
+// resident cells by material : sand, water
+#define MATERIALS 2
+static const char* materials[MATERIALS] = {"sand", "water"};
+
+struct mstats {
+	uint64_t count[MATERIALS];
+	double   y[MATERIALS]; // mean height (screen y, down is bigger)
+};
+
+static void takeStats(struct mstats* s) {
+	double sum[MATERIALS] = {0};
+	memset(s, 0, sizeof(*s));
+	for (int i = 0; i < MAPLEN; i++) {
+		for (struct chunk* c = World.map.data[i]; c; c = c->next) {
+			const uint8_t* d = getChunkData(c, MODE_READ);
+			for (int j = 0; j < CHUNK_WIDTH*CHUNK_WIDTH; j++) {
+				int m = (d[j] >> 2) ? (d[j] >> 2) % 4 - 1 : -1; // sand = 0
+				if (m < 0 || m >= MATERIALS) continue;
+				s->count[m]++;
+				sum[m] += (double)c->pos.axis[1] * CHUNK_WIDTH + j / CHUNK_WIDTH;
+			}
+		}
+	}
+	for (int m = 0; m < MATERIALS; m++)
+		s->y[m] = s->count[m] ? sum[m] / s->count[m] : 0.0;
+}
+
+static bool awayValid(void) { // sand is on the floor (y = 64), not in the air
+	struct mstats s;
+	takeStats(&s);
+	return s.count[0] && s.y[0] > 48.0;
+}
+
+static int cmpstate(const void* a, const void* b) {
+	uint32_t x = ((const struct cstate*)a)->pos, y = ((const struct cstate*)b)->pos;
+	return (x > y) - (x < y);
+}
+
+static void takeSnapshot(struct snapshot* s) {
+	int n = 0;
+	for (int i = 0; i < MAPLEN; i++)
+		for (struct chunk* c = World.map.data[i]; c; c = c->next) n++;
+
+	s->chunks = malloc(sizeof(struct cstate) * (n ? n : 1));
+	if (!s->chunks) {
+		perror("NOMEM!");
+		exit(2);
+	}
+	s->count = 0;
+	for (int i = 0; i < MAPLEN; i++)
+		for (struct chunk* c = World.map.data[i]; c; c = c->next)
+			s->chunks[s->count++] = (struct cstate){c->pos.pack, chunkHash(c)};
+
+	// hashmap order is not a part of the state
+	qsort(s->chunks, s->count, sizeof(struct cstate), cmpstate);
+	s->hash = FNV_BASIS;
+	for (int i = 0; i < s->count; i++) // field by field, no padding please
+		s->hash = fnv(s->hash, (const uint8_t*)&s->chunks[i].hash, sizeof(uint64_t));
+}
+
+static bool scenario_valid; // of the last run
+
+// stats may be NULL. Otherwise stats[0] is after setup, stats[1] at the end
+static bool runScenario(const struct scenario* sc, int engine, struct snapshot* out,
+		struct mstats* stats) {
+	initWorld();
+	openWorld(":memory:");
+	setWorldSeed(SEED);
+	World.mode = sc->mode;
+	World.engine = engine;
+
+	bool ok = initHeadless(sc->view) && headlessWaitView(100000);
+	if (ok) {
+		sc->setup();
+		if (stats) takeStats(stats);
+		for (int i = 0; i < TICKS; i++) {
+			if (sc->tick) sc->tick(i);
+			headlessTick();
+			prof_step();
+			takeSnapshot(out + i);
+		}
+		if (stats) takeStats(stats + 1);
+		scenario_valid = !sc->valid || sc->valid();
+	} else fprintf(stderr, "%s : view was not loaded!\n", sc->name);
+
+	clearWorldView();
+	freeHeadless();
+	freeWorld();
+	return ok;
+}
+
+static void freeSnapshots(struct snapshot* s) {
+	for (int i = 0; i < TICKS; i++) {
+		free(s[i].chunks);
+		s[i].chunks = NULL;
+	}
+}
+
+static struct snapshot snaps[TICKS], snaps2[TICKS];
+
+// pull engine is the reference one, it's hashes have no prefix
+static const char* goldenName(int engine, const struct scenario* sc) {
+	static char buf[128];
+	if (engine == 0) return sc->name;
+	snprintf(buf, sizeof(buf), "%s/%s", world_engines[engine], sc->name);
+	return buf;
+}
+
+static int compareEngines(int a, int b);
+
+// golden file : "scenario tick hash" lines, # for comments
+static int check(const char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return 2;
+	}
+
+	int failed = 0;
+	for (int engine = 0; engine < world_engines_count; engine++)
+	for (const struct scenario* sc = scenarios; sc->name; sc++) {
+		const char* gname = goldenName(engine, sc);
+		if (!runScenario(sc, engine, snaps, NULL)) return 2;
+
+		int checked = 0, bad = -1;
+		char line[256], name[64];
+		unsigned tick;
+		uint64_t hash;
+		rewind(f);
+		while (fgets(line, sizeof(line), f)) {
+			if (line[0] == '#') continue;
+			if (sscanf(line, "%63s %u %" SCNx64, name, &tick, &hash) != 3) continue;
+			if (strcmp(name, gname) || tick >= TICKS) continue;
+			checked++;
+			if (snaps[tick].hash != hash && (bad < 0 || (int)tick < bad)) bad = tick;
+		}
+
+		if (!scenario_valid) {
+			printf("%-21s : FAIL (bad world at the end)\n", gname);
+			failed++;
+		} else if (checked != TICKS) {
+			printf("%-21s : FAIL (%i of %i golden hashes found)\n", gname, checked, TICKS);
+			failed++;
+		} else if (bad >= 0) {
+			printf("%-21s : FAIL (diverged at tick %i)\n", gname, bad);
+			failed++;
+		} else printf("%-21s : ok\n", gname);
+		freeSnapshots(snaps);
+	}
+	fclose(f);
+
+	for (int engine = 1; engine < world_engines_count; engine++) {
+		int res = compareEngines(0, engine);
+		if (res > 1) return res;
+		failed += res;
+	}
+
+	failed += runUnits();
+	return failed ? 1 : 0;
+}
+
+static int update(const char* path) {
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		return 2;
+	}
+	fprintf(f, "# golden world hashes : scenario tick hash. See tests/determinism.c\n");
+	fprintf(f, "# regenerate with ./tests/pixelbox-check --update tests/golden.txt\n");
+
+	for (int engine = 0; engine < world_engines_count; engine++)
+	for (const struct scenario* sc = scenarios; sc->name; sc++) {
+		const char* gname = goldenName(engine, sc);
+		if (!runScenario(sc, engine, snaps, NULL)) return 2;
+		for (int i = 0; i < TICKS; i++)
+			fprintf(f, "%s %i %016" PRIx64 "\n", gname, i, snaps[i].hash);
+		freeSnapshots(snaps);
+		printf("%-21s : updated\n", gname);
+	}
+	if (fclose(f)) {
+		perror(path);
+		return 2;
+	}
+	return 0;
+}
+
+static int findEngine(const char* name) {
+	for (int i = 0; i < world_engines_count; i++)
+		if (strcmp(world_engines[i], name) == 0) return i;
+	fprintf(stderr, "unknown engine %s! Available :", name);
+	for (int i = 0; i < world_engines_count; i++) fprintf(stderr, " %s", world_engines[i]);
+	fprintf(stderr, "\n");
+	return -1;
+}
+
+// prints chunks that differ between two snapshots
+static void diffChunks(struct snapshot* a, struct snapshot* b) {
+	int i = 0, j = 0, shown = 0;
+	while ((i < a->count || j < b->count) && shown < MAX_DIFFS) {
+		struct cstate* x = i < a->count ? a->chunks + i : NULL;
+		struct cstate* y = j < b->count ? b->chunks + j : NULL;
+		union packpos p;
+
+		if (x && y && x->pos == y->pos) {
+			if (x->hash != y->hash) {
+				p.pack = x->pos;
+				printf("    chunk %i %i : content differs\n", p.axis[0], p.axis[1]);
+				shown++;
+			}
+			i++; j++;
+		} else if (!y || (x && x->pos < y->pos)) {
+			p.pack = x->pos;
+			printf("    chunk %i %i : only in the first\n", p.axis[0], p.axis[1]);
+			shown++; i++;
+		} else {
+			p.pack = y->pos;
+			printf("    chunk %i %i : only in the second\n", p.axis[0], p.axis[1]);
+			shown++; j++;
+		}
+	}
+	if (shown >= MAX_DIFFS) printf("    ...\n");
+}
+
+static int diff(const char* e1, const char* e2) {
+	int a = findEngine(e1), b = findEngine(e2);
+	if (a < 0 || b < 0) return 2;
+
+	int failed = 0;
+	for (const struct scenario* sc = scenarios; sc->name; sc++) {
+		if (!runScenario(sc, a, snaps, NULL) || !runScenario(sc, b, snaps2, NULL)) return 2;
+		int bad = -1;
+		for (int i = 0; i < TICKS && bad < 0; i++)
+			if (snaps[i].hash != snaps2[i].hash) bad = i;
+
+		if (bad >= 0) {
+			printf("%-12s : %s and %s diverged at tick %i\n", sc->name, e1, e2, bad);
+			diffChunks(snaps + bad, snaps2 + bad);
+			failed++;
+		} else printf("%-12s : same\n", sc->name);
+		freeSnapshots(snaps);
+		freeSnapshots(snaps2);
+	}
+	return failed ? 1 : 0;
+}
+
+/*
+ * Engine b must keep mass of every material (only moves are allowed),
+ * and after TICKS it must have about the same mean height of every
+ * material as engine a. Pull itself does not keep mass (two cells may
+ * pull the same atom, water loses up to ~20% here), so masses are only
+ * reported. Flat scenarios only : worldgen brings new materials with
+ * every chunk loaded, and engines load different ones.
+ */
+static int compareEngines(int a, int b) {
+	int failed = 0;
+	for (const struct scenario* sc = scenarios; sc->name; sc++) {
+		if (sc->mode != 1) continue;
+		struct mstats sa[2], sb[2];
+		if (!runScenario(sc, a, snaps, sa) || !runScenario(sc, b, snaps2, sb)) return 2;
+		freeSnapshots(snaps);
+		freeSnapshots(snaps2);
+
+		bool ok = true;
+		for (int m = 0; m < MATERIALS; m++) {
+			if (!sa[0].count[m]) continue;
+			double drift = (double)sa[1].count[m] / sa[0].count[m] - 1.0;
+			double dy = sb[1].y[m] - sa[1].y[m];
+			bool kept = sb[0].count[m] == sb[1].count[m];
+			bool good = kept && dy <= HEIGHT_TOLERANCE && dy >= -HEIGHT_TOLERANCE;
+			printf("%-12s : %-5s %s y %.1f (mass %+.1f%%), %s y %.1f (%+.1f px)%s%s\n",
+				sc->name, materials[m], world_engines[a], sa[1].y[m], drift * 100.0,
+				world_engines[b], sb[1].y[m], dy,
+				kept ? "" : " MASS NOT KEPT", good ? "" : " FAIL");
+			ok &= good;
+		}
+		failed += !ok;
+	}
+	return failed ? 1 : 0;
+}
+
+static int compare(const char* e1, const char* e2) {
+	int a = findEngine(e1), b = findEngine(e2);
+	if (a < 0 || b < 0) return 2;
+	return compareEngines(a, b);
+}
+
+int main(int argc, char** argv) {
+	int res = 2;
+	prof_register_thread();
+	if (argc == 2) res = check(argv[1]);
+	else if (argc == 3 && strcmp(argv[1], "--update") == 0) res = update(argv[2]);
+	else if (argc == 4 && strcmp(argv[1], "--diff") == 0) res = diff(argv[2], argv[3]);
+	else if (argc == 4 && strcmp(argv[1], "--compare") == 0) res = compare(argv[2], argv[3]);
+	else fprintf(stderr, "usage : %s [--update] golden.txt | --diff|--compare ENGINE ENGINE\n", argv[0]);
+	prof_unregister_thread();
+	return res;
+}
@@ -0,0 +1,191 @@
+/*
+ * This file is a part of Pixelbox - Infinite 2D sandbox game
+ * Copyright (C) 2023 UtoECat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "implix.h"
+#include "headless.h"
+#include "edit.h"
+#include "atlas.h"
+#include "units.h"
+#include <stdio.h>
+#include <string.h>
+
+static bool loadChunks(int x0, int y0, int x1, int y1) {
+	for (int i = 0; i < 100000; i++) {
+		bool ready = true;
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				if (getWorldChunk(x, y) == &empty) ready = false;
+		if (ready) return true;
+		saveloadTick();
+	}
+	return false;
+}
+
+/*
+ * Paste into chunks that are not loaded. Load queue gets them way
+ * slower, than GC collects not touched ones, so pending chunks must
+ * be kept alive until they arrive. Simulation does not run, pasted
+ * floor would fall out of the region.
+ */
+
+#define PASTE_W 40 // chunks, 1600 of them are loaded in ~160 ticks
+#define PASTE_X 1000
+#define PASTE_Y -500
+
+static bool pasteBig(void) {
+	initWorld();
+	openWorld(":memory:");
+	World.mode = 1; // flat, floor at y = 64 : region has air and floor
+	struct headless_view view = {0, 0, PASTE_W - 1, PASTE_W - 1};
+	bool ok = initHeadless(view) && headlessWaitView(100000);
+
+	int missing = 0, deferred = 0, pastes = -1, waiting = -1, dropped = -1;
+	struct world_region *r = NULL, *t = NULL;
+	if (ok) r = copyWorldRegion(0, 0, PASTE_W - 1, PASTE_W - 1, &missing);
+	if (r) {
+		struct world_paste p = {r, PASTE_X * CHUNK_WIDTH, PASTE_Y * CHUNK_WIDTH, false};
+		deferred = pasteWorldRegion(&p);
+		for (int i = 0; i < 100000; i++) {
+			pasteStats(&pastes, &waiting, &dropped);
+			if (!pastes) break;
+			saveloadTick();
+			collectGarbage();
+		}
+		if (loadChunks(PASTE_X, PASTE_Y, PASTE_X + PASTE_W - 1, PASTE_Y + PASTE_W - 1))
+			t = copyWorldRegion(PASTE_X, PASTE_Y,
+				PASTE_X + PASTE_W - 1, PASTE_Y + PASTE_W - 1, NULL);
+	}
+
+	ok = r && t && !missing && deferred == PASTE_W * PASTE_W &&
+		!pastes && !waiting && !dropped && t->size == r->size &&
+		!memcmp(t->tiles, r->tiles, (PASTE_W * PASTE_W + 1) * sizeof(*r->tiles)) &&
+		!memcmp(t->data, r->data, r->size);
+	if (r) freeWorldRegion(r);
+	if (t) freeWorldRegion(t);
+	freeHeadless();
+	freeWorld();
+
+	if (!ok) printf("%-21s : FAIL (%i deferred, %i pastes and %i chunks left, %i dropped)\n",
+		"paste_big", deferred, pastes, waiting, dropped);
+	else printf("%-21s : ok\n", "paste_big");
+	return ok;
+}
+
+/*
+ * Known answers of the counter-based RNG (see pixel.h). Saved worlds and
+ * golden hashes depend on these streams, so they must be the same on
+ * every platform, and never change by accident.
+ */
+
+static bool rngAnswers(void) {
+	const uint64_t key = rngKey(1337, 42, 0x00030005);
+	const uint64_t at[] = {0x0798616be8ed9b6cull, 0x5515281fdd4e8550ull, 0x1d948098f90bbe00ull};
+	const uint8_t bytes[13] = { // values 7 and 8, low byte first
+		0xd4, 0x3d, 0x09, 0x31, 0xe0, 0x05, 0xb9, 0xd3, 0x03, 0x51, 0xfc, 0xdb, 0xae
+	};
+
+	bool ok = key == 0x95b58a44cdac9df3ull && rngAt(key, 1000) == 0xc643136e525cccfdull;
+	struct rng_stream s = {key, 0};
+	for (int i = 0; i < 3; i++) {
+		if (rngAt(key, i) != at[i]) ok = false;
+		if (rngNext(&s) != at[i]) ok = false;
+	}
+
+	uint8_t out[14];
+	out[13] = 0x5a; // must stay untouched
+	rngFillBytes(key, 7, out, 13);
+	if (memcmp(out, bytes, 13) || out[13] != 0x5a) ok = false;
+
+	printf("%-21s : %s\n", "rng_answers", ok ? "ok" : "FAIL (stream changed)");
+	return ok;
+}
+
+/*
+ * Dirty span merging of the render atlas, no GL needed (see atlas.h).
+ * Atlas is 8x8 tiles of 2x2 pixels, every tile is filled with it's
+ * index + 1, so the packed data tells where it came from.
+ */
+
+#define ATLAS_W 8
+#define ATLAS_T 2
+
+static void putTile(struct atlas* a, int x, int y) {
+	uint8_t data[ATLAS_T * ATLAS_T];
+	memset(data, x + y * ATLAS_W + 1, sizeof(data));
+	atlasPut(a, x + y * ATLAS_W, data);
+}
+
+// next span must be this rectangle (in tiles), packed row by row
+static bool nextSpanIs(struct atlas* a, int x, int y, int w, int h) {
+	struct atlas_span s;
+	if (!atlasNextSpan(a, &s)) return false;
+	if (s.x != x * ATLAS_T || s.y != y * ATLAS_T ||
+		s.width != w * ATLAS_T || s.height != h * ATLAS_T) return false;
+
+	const int pitch = ATLAS_W * ATLAS_T;
+	for (int i = 0; i < s.height; i++)
+		for (int j = 0; j < s.width; j++) {
+			uint8_t v = s.data[i * s.width + j];
+			if (v != a->pixels[(s.y + i) * pitch + s.x + j]) return false;
+			int tx = (s.x + j) / ATLAS_T, ty = (s.y + i) / ATLAS_T;
+			if (v && v != tx + ty * ATLAS_W + 1) return false;
+		}
+	return true;
+}
+
+static bool atlasSpans(void) {
+	struct atlas a;
+	if (!initAtlas(&a, ATLAS_T, ATLAS_W, ATLAS_W)) return false;
+	bool ok = !atlasNextSpan(&a, &(struct atlas_span){0}); // clean
+
+	// overlapping and touching rows are one span, holes are uploaded too
+	putTile(&a, 2, 0);
+	putTile(&a, 3, 0);
+	putTile(&a, 4, 1); // touches row 0
+	putTile(&a, 3, 2); // overlaps row 1
+	ok = ok && nextSpanIs(&a, 2, 0, 3, 3) && !atlasNextSpan(&a, &(struct atlas_span){0});
+
+	// far away rows, and rows with a clean row between, are not merged
+	putTile(&a, 0, 0);
+	putTile(&a, 6, 1);
+	putTile(&a, 1, 4);
+	putTile(&a, 1, 6);
+	ok = ok && nextSpanIs(&a, 0, 0, 1, 1) && nextSpanIs(&a, 6, 1, 1, 1) &&
+		nextSpanIs(&a, 1, 4, 1, 1) && nextSpanIs(&a, 1, 6, 1, 1) &&
+		!atlasNextSpan(&a, &(struct atlas_span){0});
+
+	// full width span is the mirror itself, nothing is packed
+	putTile(&a, 0, 3);
+	atlasMark(&a, ATLAS_W - 1 + 3 * ATLAS_W);
+	struct atlas_span s;
+	ok = ok && atlasNextSpan(&a, &s) && s.width == ATLAS_W * ATLAS_T &&
+		s.height == ATLAS_T && s.data == a.pixels + 3 * ATLAS_T * ATLAS_W * ATLAS_T &&
+		!atlasNextSpan(&a, &s);
+
+	freeAtlas(&a);
+	printf("%-21s : %s\n", "atlas_spans", ok ? "ok" : "FAIL (bad spans)");
+	return ok;
+}
+
+int runUnits(void) {
+	int failed = 0;
+	failed += !atlasSpans();
+	failed += !rngAnswers();
+	failed += !pasteBig();
+	return failed;
+}
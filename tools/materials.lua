@@ -0,0 +1,56 @@
+--[[
+-- This file is a part of PixelBox - infinite sandbox game
+-- Material table. Compiled into ./src/materials-generated.h by
+-- ./tools/matgen (see matgen.lua) at build time.
+-- Copyright (C) 2023 UtoECat
+--
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+--
+-- Pixel value is (material << 2) | variant, so there are 64 materials.
+-- Lowest variant bit is the direction of liquids (1 - right).
+--
+-- Every material gets defaults of it's kind (material % 4, as before),
+-- and may override any of them in the materials table below :
+--   density : 0 - empty (things move into it), 255 - never displaced.
+--             Falling things sink into lighter, not solid, ones
+--   gravity : falls down
+--   spread  : "pile" - slides aside under the weight of the same
+--             spread above it, "flow" - goes in it's direction when
+--             standing on something
+--
+-- Reactions : material touching (4 neighbours) another one turns into
+-- a third one, with chance/256 probability per tick. Pull engine only.
+--
+-- Kernels are generated for the rules the table really uses, so unused
+-- features (density differences, reactions, ...) cost nothing at all.
+--]]
+
+kinds = {
+	[0] = {name = "solid",   density = 255},
+	[1] = {name = "sand",    density = 1, gravity = true, spread = "pile"},
+	[2] = {name = "water",   density = 1, gravity = true, spread = "flow"},
+	[3] = {name = "special", density = 255},
+}
+
+materials = {
+	[0] = {name = "air", density = 0},
+	[1] = {name = "sand"},
+	[2] = {name = "water"},
+	[3] = {name = "special"},
+	-- [5] = {name = "mud", density = 2}, -- sinks in water
+}
+
+reactions = {
+	-- {"water", "special", "sand", chance = 16},
+}
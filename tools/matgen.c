@@ -0,0 +1,25 @@
+#define LUA_IMPL
+#include "minilua.h"
+#include <stdio.h>
+
+// runs tools/matgen.lua : material table => ./src/materials-generated.h
+int main(int argc, const char** argv) {
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_newtable(L);
+	for(int i = 1; i < argc; i++) {
+		lua_pushstring(L, argv[i]);
+		lua_seti(L, -2, i);
+	}
+	lua_setglobal(L, "arg");
+
+	if (luaL_dofile(L, "tools/matgen.lua") != LUA_OK) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		lua_close(L);
+		return -1;
+	}
+
+	lua_close(L);
+	return 0;
+}
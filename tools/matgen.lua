@@ -0,0 +1,281 @@
+--[[
+-- This file is a part of PixelBox - infinite sandbox game
+-- Compiles material table (materials.lua) into lookup tables and
+-- specialized per stage kernels. C header goes to stdout!
+-- Copyright (C) 2023 UtoECat
+--
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <https://www.gnu.org/licenses/>.
+--]]
+
+local out = io.stdout
+local COUNT = 64
+
+local function fail(...)
+	io.stderr:write("matgen : ", string.format(...), "\n")
+	os.exit(5)
+end
+
+dofile(arg[1] or "tools/materials.lua")
+
+-- resolve every material
+local mats, byname = {}, {}
+for m = 0, COUNT - 1 do
+	local kind = kinds[m % 4]
+	local def = materials[m] or {}
+	local t = {}
+	for k, v in pairs(kind) do t[k] = v end
+	for k, v in pairs(def) do t[k] = v end
+	if not materials[m] then t.name = kind.name .. (m // 4) end
+	if m == 0 and t.density ~= 0 then fail("air must be empty") end
+	if t.spread and t.spread ~= "pile" and t.spread ~= "flow" then
+		fail("%s : unknown spread %q", t.name, t.spread)
+	end
+	if t.density < 0 or t.density > 255 then fail("%s : bad density", t.name) end
+	if byname[t.name] then fail("%s : name is taken", t.name) end
+	byname[t.name] = m
+	mats[m] = t
+end
+
+local function material(name)
+	return byname[name] or fail("unknown material %q", tostring(name))
+end
+
+-- reactions by the material that changes
+local react, nreact = {}, 0
+for _, r in ipairs(reactions) do
+	local a, b, into = material(r[1]), material(r[2]), material(r[3])
+	local chance = r.chance or 256
+	if chance < 1 or chance > 256 then fail("%s : bad chance", r[1]) end
+	react[a] = react[a] or {}
+	table.insert(react[a], {b = b, into = into, chance = chance})
+	nreact = nreact + 1
+end
+
+-- what do we really need?
+local has = {pile = false, flow = false, density = false}
+local dens = nil
+for m = 0, COUNT - 1 do
+	local t = mats[m]
+	if t.spread then has[t.spread] = true end
+	if t.density > 0 and t.density < 255 then
+		if dens and dens ~= t.density then has.density = true end
+		dens = dens or t.density
+	end
+end
+
+local FLAGS = {
+	{"EMPTY",   function(t) return t.density == 0 end},
+	{"SOLID",   function(t) return t.density == 255 end},
+	{"GRAVITY", function(t) return t.gravity end},
+	{"PILE",    function(t) return t.spread == "pile" end},
+	{"FLOW",    function(t) return t.spread == "flow" end},
+	{"REACTS",  function(t, m) return react[m] ~= nil end},
+}
+
+local buff = {}
+local function emit(s, ...)
+	buff[#buff + 1] = string.format(s, ...)
+end
+
+local function table256(name, get)
+	emit("static const uint8_t %s[256] = {", name)
+	for v = 0, 255 do
+		if v % 16 == 0 then emit("\n\t") end
+		emit("%i,%s", get(mats[v >> 2], v >> 2), v % 16 == 15 and "" or " ")
+	end
+	emit("\n};\n\n")
+end
+
+emit([[/* THIS FILE IS AUTOGENERATED!
+* SEE ./tools/materials.lua and ./tools/matgen.lua FOR DETAILS!
+* DO NOT EDIT! */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAT_COUNT %i
+#define MAT_HAS_DENSITY %i // falling things may sink
+#define MAT_REACTIONS %i
+
+]], COUNT, has.density and 1 or 0, nreact)
+
+for i, f in ipairs(FLAGS) do emit("#define MAT_%-8s %i\n", f[1], 1 << (i - 1)) end
+emit("\n// by pixel value, not by material!\n")
+
+table256("mat_flags", function(t, m)
+	local r = 0
+	for i, f in ipairs(FLAGS) do if f[2](t, m) then r = r | (1 << (i - 1)) end end
+	return r
+end)
+table256("mat_density", function(t) return t.density end)
+
+emit("static const char* const mat_names[MAT_COUNT] = {")
+for m = 0, COUNT - 1 do
+	emit("%s%q,", m % 8 == 0 and "\n\t" or " ", mats[m].name)
+end
+emit("\n};\n\n")
+
+emit("// may a fall into b?\nstatic inline bool matSinks(uint8_t a, uint8_t b) {\n")
+if has.density then
+	emit("\treturn (mat_flags[a] & MAT_GRAVITY) && !(mat_flags[b] & MAT_SOLID) &&\n")
+	emit("\t\tmat_density[b] < mat_density[a];\n}\n\n")
+else
+	emit("\treturn (mat_flags[a] & MAT_GRAVITY) && (mat_flags[b] & MAT_EMPTY);\n}\n\n")
+end
+
+-- kernels, for the pull engine. Included by pixel.c only
+
+emit([[#ifdef MAT_KERNELS
+// uses struct updater, getpixel() and markUpdate() of pixel.c
+
+#define IS(V, F) (mat_flags[V] & MAT_##F)
+
+]])
+
+-- stage 0 : fall
+emit("static inline void matStage0(struct updater* u) {\n")
+if has.density then
+	emit([[
+	if (IS(u->v, SOLID)) return;
+	const uint8_t b = getpixel(u, u->x, u->y + 1);
+	if (matSinks(u->v, b)) { // unless b sinks too
+		if (!matSinks(b, getpixel(u, u->x, u->y + 2))) {
+			u->v = b;
+			markUpdate(u, u->x, u->y + 1);
+		}
+		return;
+	}
+	const uint8_t a = getpixel(u, u->x, u->y - 1);
+	if (matSinks(a, u->v)) { // and we don't sink, see above
+		u->v = a;
+		markUpdate(u, u->x, u->y - 1);
+	}
+]])
+else
+	emit([[
+	const uint8_t f = mat_flags[u->v];
+	if (f & MAT_EMPTY) {
+		const uint8_t a = getpixel(u, u->x, u->y - 1);
+		if (IS(a, GRAVITY)) {
+			u->v = a;
+			markUpdate(u, u->x, u->y - 1);
+		}
+	} else if (f & MAT_GRAVITY) {
+		const uint8_t b = getpixel(u, u->x, u->y + 1);
+		if (IS(b, EMPTY)) {
+			u->v = b;
+			markUpdate(u, u->x, u->y + 1);
+		}
+	}
+]])
+end
+emit("}\n\n")
+
+-- stages 1 and 2 : slide and flow, to the right and to the left
+local function sideStage(n, s)
+	emit("static inline void matStage%i(struct updater* u) {\n", n)
+	if not has.pile and not has.flow then
+		emit("\t(void)u;\n}\n\n")
+		return
+	end
+	emit("\tconst uint8_t f = mat_flags[u->v];\n")
+	emit("\tif (f & MAT_EMPTY) {\n")
+	emit("\t\tconst uint8_t a = getpixel(u, u->x%s1, u->y);\n", s)
+	if has.pile then emit([[
+		if (IS(a, PILE) && IS(getpixel(u, u->x%s1, u->y-1), PILE)) {
+			u->v = a;
+			markUpdate(u, u->x%s1, u->y);
+			return;
+		}
+]], s, s, s) end
+	if has.flow and n == 1 then emit([[
+		const int dir = (a & 1)*2-1;
+		if (IS(a, FLOW) && !IS(getpixel(u, u->x-dir, u->y+1), EMPTY)) {
+			u->v = a;
+			markUpdate(u, u->x-dir, u->y);
+			return;
+		}
+]]) elseif has.flow then emit([[
+		if (IS(a, FLOW) && !IS(getpixel(u, u->x%s1, u->y+1), EMPTY)) {
+			u->v = a;
+			markUpdate(u, u->x%s1, u->y);
+			return;
+		}
+]], s, s) end
+	emit("\t}")
+	local o = s == "-" and "+" or "-"
+	if has.pile then emit([[ else if ((f & MAT_PILE) && IS(getpixel(u, u->x, u->y-1), PILE)) {
+		const uint8_t a = getpixel(u, u->x%s1, u->y);
+		if (IS(a, EMPTY)) {
+			u->v = a;
+			markUpdate(u, u->x%s1, u->y);
+		}
+	}]], o, o) end
+	if has.flow then emit([[ else if ((f & MAT_FLOW) && !IS(getpixel(u, u->x, u->y+1), EMPTY)) {
+		const int dir = %s;
+		const uint8_t a = getpixel(u, u->x+dir, u->y);
+		if (IS(a, EMPTY)) {
+			u->v = a;
+			markUpdate(u, u->x+dir, u->y);
+		}
+	}]], n == 1 and "(u->v & 1)*2-1" or "-1") end
+	emit("\n}\n\n")
+end
+
+sideStage(1, "-")
+sideStage(2, "+")
+
+local stages = 3
+if nreact > 0 then
+	stages = 4
+	emit([[
+static inline bool matTouches(const uint8_t n[4], uint8_t m) {
+	return (n[0] >> 2) == m || (n[1] >> 2) == m || (n[2] >> 2) == m || (n[3] >> 2) == m;
+}
+
+static inline bool matChance(const struct updater* u, unsigned chance) {
+	return (rngAt(chunkRng(u->c).key, u->x + u->y * CHUNK_WIDTH) & 255) < chance;
+}
+
+// stage 3 : reactions
+static inline void matStage3(struct updater* u) {
+	if (!IS(u->v, REACTS)) return;
+	const uint8_t n[4] = {
+		getpixel(u, u->x, u->y-1), getpixel(u, u->x, u->y+1),
+		getpixel(u, u->x-1, u->y), getpixel(u, u->x+1, u->y)
+	};
+	switch (u->v >> 2) {
+]])
+	for m = 0, COUNT - 1 do
+		if react[m] then
+			emit("\tcase %i : // %s\n", m, mats[m].name)
+			for _, r in ipairs(react[m]) do
+				emit("\t\tif (matTouches(n, %i)%s) {\n", r.b,
+					r.chance < 256 and string.format(" && matChance(u, %i)", r.chance) or "")
+				emit("\t\t\tu->v = (%i << 2) | (u->v & 3); // %s\n\t\t\treturn;\n\t\t}\n",
+					r.into, mats[r.into].name)
+			end
+			emit("\t\tbreak;\n")
+		end
+	end
+	emit("\tdefault : break;\n\t}\n}\n\n")
+end
+
+emit("#undef IS\n\n#define MAT_STAGES %i\n#define MAT_FOR_STAGES(X)", stages)
+for i = 0, stages - 1 do emit(" X(%i, matStage%i)", i, i) end
+emit("\n\n#endif\n")
+
+out:write(table.concat(buff))
+out:flush()